@@ -0,0 +1,422 @@
+/*
+ * cache.c - Set-associative cache model used by csim
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "snapshot.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int init_cache(Cache* c, int s, int E, int b, const Policy* policy, unsigned long long seed) { //allocate cache and initialize
+    memset(c, 0, sizeof(Cache));
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    c->S = 1ULL << s;
+    c->ways = (E + SIMD_WAYS - 1) / SIMD_WAYS * SIMD_WAYS;
+    c->valid_words = (E + 63) / 64;
+    c->write_back = 1;
+    c->write_allocate = 1;
+    c->policy = policy;
+    c->seed = seed;
+    size_t lines = c->S * c->ways;
+    size_t words = 2 * lines + 3 * c->S * c->valid_words;
+    void* mem = NULL;
+    if(posix_memalign(&mem, 64, words * sizeof(unsigned long long)) != 0) {
+        fprintf(stderr, "Unable to allocate %llu sets of %d lines\n", c->S, E);
+        exit(1);
+    }
+    c->tags = mem;
+    c->age = c->tags + lines;
+    c->valid = c->age + lines;
+    c->dirty = c->valid + c->S * c->valid_words;
+    c->prefetched = c->dirty + c->S * c->valid_words;
+    memset(mem, 0, words * sizeof(unsigned long long));
+    if(policy->init && policy->init(c) < 0) {
+        free_cache(c);
+        return -1;
+    }
+
+    c->hashed = E >= LRU_LIST_WAYS;
+    c->lru_list = c->hashed && policy->list;
+    if(c->hashed) {
+        for(c->slots = 1; c->slots < 2 * (unsigned int)E; c->slots <<= 1)
+            ;
+        c->slot = calloc(c->S * c->slots, sizeof(unsigned int));
+        if(!c->slot) {
+            fprintf(stderr, "Unable to allocate tag hashes for %llu sets of %d lines\n", c->S, E);
+            exit(1);
+        }
+    }
+    if(c->lru_list) {
+        c->next = malloc((2 * lines + 3 * c->S) * sizeof(unsigned int));
+        if(!c->next) {
+            fprintf(stderr, "Unable to allocate LRU lists for %llu sets of %d lines\n", c->S, E);
+            exit(1);
+        }
+        c->prev = c->next + lines;
+        c->head = c->prev + lines;
+        c->tail = c->head + c->S;
+        c->free_head = c->tail + c->S;
+        for(unsigned long long set_idx = 0; set_idx < c->S; ++set_idx) { //every way starts empty
+            unsigned int* next = c->next + set_idx * c->ways;
+            for(int i = 0; i < E; ++i)
+                next[i] = i < E - 1 ? (unsigned int)i + 1 : NIL;
+            c->head[set_idx] = c->tail[set_idx] = NIL;
+            c->free_head[set_idx] = 0;
+        }
+    }
+    return 0;
+}
+
+int alloc_set_state(Cache* c, int words) {
+    c->state_words = words;
+    c->set_state = calloc(c->S * words, sizeof(unsigned long long));
+    return c->set_state ? 0 : -1;
+}
+
+/*
+ * find_way - Way of the set holding tag, or -1. Tags of all ways are
+ *     compared with vector instructions and the match mask is then
+ *     filtered by the valid bits, 64 ways at a time.
+ */
+static inline int find_way(const Cache* c, unsigned long long set_idx, unsigned long long tag) {
+    const unsigned long long* tags = c->tags + set_idx * c->ways;
+    const unsigned long long* valid = c->valid + set_idx * c->valid_words;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi64x(tag);
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi64x(tag);
+#endif
+    for(int w = 0; w < c->valid_words; ++w) {
+        int base = w * 64;
+        int n = c->ways - base < 64 ? c->ways - base : 64;
+        unsigned long long match = 0;
+#if defined(__AVX2__)
+        for(int i = 0; i < n; i += 4) {
+            __m256i v = _mm256_load_si256((const __m256i*)(tags + base + i));
+            __m256i eq = _mm256_cmpeq_epi64(v, key);
+            match |= (unsigned long long)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+        }
+#elif defined(__SSE2__)
+        for(int i = 0; i < n; i += 2) { //64-bit equality from two 32-bit halves
+            __m128i v = _mm_load_si128((const __m128i*)(tags + base + i));
+            __m128i eq = _mm_cmpeq_epi32(v, key);
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            match |= (unsigned long long)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+        }
+#else
+        for(int i = 0; i < n; ++i)
+            match |= (unsigned long long)(tags[base + i] == tag) << i;
+#endif
+        match &= valid[w];
+        if(match)
+            return base + __builtin_ctzll(match);
+    }
+    return -1;
+}
+
+static inline unsigned int tag_hash(unsigned long long tag, unsigned int mask) {
+    tag ^= tag >> 31;
+    tag *= 0xbf58476d1ce4e5b9ULL;
+    tag ^= tag >> 29;
+    return tag & mask;
+}
+
+/*
+ * hash_slot - Hash slot of the set holding tag's way, or the empty slot
+ *     where tag would be inserted
+ */
+static inline unsigned int* hash_slot(const Cache* c, unsigned long long set_idx, unsigned long long tag) {
+    unsigned int* table = c->slot + set_idx * c->slots;
+    const unsigned long long* tags = c->tags + set_idx * c->ways;
+    unsigned int mask = c->slots - 1;
+    unsigned int i = tag_hash(tag, mask);
+    while(table[i] && tags[table[i] - 1] != tag)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+/*
+ * hash_remove - Empty a hash slot, shifting later entries of its probe
+ *     run back so lookups never need tombstones
+ */
+static void hash_remove(const Cache* c, unsigned long long set_idx, unsigned int* hole) {
+    unsigned int* table = c->slot + set_idx * c->slots;
+    const unsigned long long* tags = c->tags + set_idx * c->ways;
+    unsigned int mask = c->slots - 1;
+    unsigned int i = hole - table, j = i;
+    for(;;) {
+        j = (j + 1) & mask;
+        if(!table[j])
+            break;
+        unsigned int k = tag_hash(tags[table[j] - 1], mask); //home slot of entry j
+        if((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i] = 0;
+}
+
+/*
+ * free_way - An empty way of the set, or -1 if the set is full
+ */
+static inline int free_way(Cache* c, unsigned long long set_idx) {
+    if(c->lru_list) {
+        unsigned int way = c->free_head[set_idx];
+        if(way == NIL)
+            return -1;
+        c->free_head[set_idx] = c->next[set_idx * c->ways + way];
+        return way;
+    }
+    const unsigned long long* valid = c->valid + set_idx * c->valid_words;
+    for(int w = 0; w < c->valid_words; ++w) {
+        int n = c->E - w * 64;
+        unsigned long long empty = ~valid[w];
+        if(n < 64)
+            empty &= (1ULL << n) - 1;
+        if(empty)
+            return w * 64 + __builtin_ctzll(empty);
+    }
+    return -1;
+}
+
+static inline unsigned long long tag_bits(const Cache* c, unsigned long long address) {
+    return c->s + c->b >= 64 ? 0 : address >> (c->s + c->b);
+}
+
+/*
+ * line_address - First byte of the block held by a way
+ */
+static inline unsigned long long line_address(const Cache* c, unsigned long long set_idx, int way) {
+    unsigned long long tag = c->tags[set_idx * c->ways + way];
+    unsigned long long address = c->b >= 64 ? 0 : set_idx << c->b;
+    if(c->s + c->b < 64)
+        address |= tag << (c->s + c->b);
+    return address;
+}
+
+/*
+ * lookup_way - Way holding tag or -1; for hashed sets also the slot
+ */
+static inline int lookup_way(const Cache* c, unsigned long long set_idx, unsigned long long tag, unsigned int** slot) {
+    if(c->hashed) {
+        *slot = hash_slot(c, set_idx, tag);
+        return (int)**slot - 1;
+    }
+    return find_way(c, set_idx, tag);
+}
+
+/* Flags of a line filled by install */
+#define FILL_DIRTY 1
+#define FILL_PREFETCH 2
+
+/*
+ * install - Put tag into the set after a miss, evicting if it is full.
+ *     slot is the tag's empty hash slot for hashed sets. Returns the
+ *     LINE_* state of the evicted line.
+ */
+static inline int install(Cache* c, Counters* cnt, unsigned long long set_idx, unsigned long long tag,
+                          unsigned int* slot, int flags, unsigned long long now, unsigned long long* victim) {
+    unsigned long long* tags = c->tags + set_idx * c->ways;
+    unsigned long long* dirty_word;
+    unsigned long long* prefetched;
+    int evicted = LINE_NONE;
+    int way = free_way(c, set_idx);
+    if(way < 0) { //line replacement through the policy
+        ++cnt->evict;
+        way = c->policy->victim(c, set_idx);
+        evicted = c->dirty[set_idx * c->valid_words + way / 64] >> (way % 64) & 1 ? LINE_DIRTY : LINE_CLEAN;
+        if(evicted == LINE_DIRTY)
+            ++cnt->dirty_evict;
+        if(c->prefetched[set_idx * c->valid_words + way / 64] >> (way % 64) & 1)
+            ++cnt->pf_unused;
+        if(victim)
+            *victim = line_address(c, set_idx, way);
+        if(c->lru_list)
+            list_unlink(c, set_idx, way);
+        if(c->hashed) {
+            hash_remove(c, set_idx, hash_slot(c, set_idx, tags[way]));
+            slot = hash_slot(c, set_idx, tag); //removal may have moved the free slot
+        }
+    }
+    c->valid[set_idx * c->valid_words + way / 64] |= 1ULL << (way % 64);
+    dirty_word = &c->dirty[set_idx * c->valid_words + way / 64];
+    *dirty_word = (*dirty_word & ~(1ULL << (way % 64))) | (unsigned long long)((flags & FILL_DIRTY) != 0) << (way % 64);
+    prefetched = &c->prefetched[set_idx * c->valid_words + way / 64];
+    *prefetched = (*prefetched & ~(1ULL << (way % 64))) | (unsigned long long)((flags & FILL_PREFETCH) != 0) << (way % 64);
+    tags[way] = tag;
+    if(c->hashed)
+        *slot = way + 1;
+    c->policy->fill(c, set_idx, way, now);
+    return evicted;
+}
+
+static inline void mark_dirty(Cache* c, unsigned long long set_idx, int way) {
+    c->dirty[set_idx * c->valid_words + way / 64] |= 1ULL << (way % 64);
+}
+
+int access_cache(Cache* c, Counters* cnt, unsigned long long address, int write, int size,
+                 unsigned long long* victim) { //access cache
+    unsigned long long tag = tag_bits(c, address); //tag bit
+    unsigned long long set_idx = set_index(c, address); //set index bit
+    unsigned long long now = cnt->time_counter++;
+    unsigned int* slot = NULL;
+    int evicted;
+
+    int way = lookup_way(c, set_idx, tag, &slot);
+    /*hit*/
+    if(way >= 0) {
+        unsigned long long* prefetched = &c->prefetched[set_idx * c->valid_words + way / 64];
+        ++cnt->hit;
+        c->policy->hit(c, set_idx, way, now);
+        if(write && c->write_back)
+            mark_dirty(c, set_idx, way);
+        else if(write)
+            cnt->bytes_written += size;
+        if(*prefetched >> (way % 64) & 1) {
+            *prefetched &= ~(1ULL << (way % 64));
+            return ACCESS_PREFETCH_HIT;
+        }
+        return ACCESS_HIT;
+    }
+    /*miss*/
+    ++cnt->miss;
+    if(write && !c->write_allocate) { //straight to the next level
+        cnt->bytes_written += size;
+        return ACCESS_MISS;
+    }
+    cnt->bytes_read += 1ULL << c->b;
+    evicted = install(c, cnt, set_idx, tag, slot, write && c->write_back ? FILL_DIRTY : 0, now, victim);
+    if(evicted == LINE_DIRTY)
+        cnt->bytes_written += 1ULL << c->b;
+    if(write && !c->write_back)
+        cnt->bytes_written += size;
+    return evicted ? ACCESS_EVICT : ACCESS_MISS;
+}
+
+int lookup_cache(Cache* c, Counters* cnt, unsigned long long address) {
+    unsigned long long tag = tag_bits(c, address);
+    unsigned long long set_idx = set_index(c, address);
+    unsigned long long now = cnt->time_counter++;
+    unsigned int* slot = NULL;
+
+    int way = lookup_way(c, set_idx, tag, &slot);
+    if(way >= 0) {
+        ++cnt->hit;
+        c->policy->hit(c, set_idx, way, now);
+        return 1;
+    }
+    ++cnt->miss;
+    return 0;
+}
+
+int fill_cache(Cache* c, Counters* cnt, unsigned long long address, int dirty, unsigned long long* victim) {
+    unsigned long long tag = tag_bits(c, address);
+    unsigned long long set_idx = set_index(c, address);
+    unsigned int* slot = NULL;
+
+    if(lookup_way(c, set_idx, tag, &slot) >= 0)
+        return LINE_NONE;
+    return install(c, cnt, set_idx, tag, slot, dirty ? FILL_DIRTY : 0, cnt->time_counter++, victim);
+}
+
+int prefetch_cache(Cache* c, Counters* cnt, unsigned long long address, unsigned long long* victim) {
+    unsigned long long tag = tag_bits(c, address);
+    unsigned long long set_idx = set_index(c, address);
+    unsigned int* slot = NULL;
+
+    if(lookup_way(c, set_idx, tag, &slot) >= 0)
+        return -1;
+    ++cnt->pf_issued;
+    cnt->bytes_read += 1ULL << c->b;
+    int evicted = install(c, cnt, set_idx, tag, slot, FILL_PREFETCH, cnt->time_counter++, victim);
+    if(evicted == LINE_DIRTY)
+        cnt->bytes_written += 1ULL << c->b;
+    return evicted;
+}
+
+int probe_cache(const Cache* c, unsigned long long address) {
+    unsigned int* slot = NULL;
+    return lookup_way(c, set_index(c, address), tag_bits(c, address), &slot) >= 0;
+}
+
+int write_cache(Cache* c, unsigned long long address) {
+    unsigned long long set_idx = set_index(c, address);
+    unsigned int* slot = NULL;
+
+    int way = lookup_way(c, set_idx, tag_bits(c, address), &slot);
+    if(way < 0)
+        return 0;
+    if(c->write_back)
+        mark_dirty(c, set_idx, way);
+    return 1;
+}
+
+int invalidate_cache(Cache* c, unsigned long long address) {
+    unsigned long long set_idx = set_index(c, address);
+    unsigned int* slot = NULL;
+
+    int way = lookup_way(c, set_idx, tag_bits(c, address), &slot);
+    if(way < 0)
+        return LINE_NONE;
+    int state = c->dirty[set_idx * c->valid_words + way / 64] >> (way % 64) & 1 ? LINE_DIRTY : LINE_CLEAN;
+    c->valid[set_idx * c->valid_words + way / 64] &= ~(1ULL << (way % 64));
+    if(c->hashed)
+        hash_remove(c, set_idx, slot);
+    if(c->lru_list) { //back onto the free list
+        list_unlink(c, set_idx, way);
+        c->next[set_idx * c->ways + way] = c->free_head[set_idx];
+        c->free_head[set_idx] = way;
+    }
+    return state;
+}
+
+unsigned long long valid_lines(const Cache* c) {
+    unsigned long long n = 0;
+    for(unsigned long long i = 0; i < c->S * c->valid_words; ++i)
+        n += __builtin_popcountll(c->valid[i]);
+    return n;
+}
+
+int save_cache(const Cache* c, FILE* fp) {
+    size_t lines = c->S * c->ways;
+    if(snap_put_words(fp, c->tags, 2 * lines + 3 * c->S * c->valid_words) < 0 ||
+       snap_put_words(fp, c->set_state, c->S * c->state_words) < 0 || snap_put(fp, &c->psel, sizeof(c->psel)) < 0)
+        return -1;
+    if(c->lru_list && snap_put(fp, c->next, (2 * lines + 3 * c->S) * sizeof(unsigned int)) < 0)
+        return -1;
+    if(c->hashed && snap_put(fp, c->slot, c->S * c->slots * sizeof(unsigned int)) < 0)
+        return -1;
+    return 0;
+}
+
+int load_cache(Cache* c, FILE* fp) {
+    size_t lines = c->S * c->ways;
+    if(snap_get_words(fp, c->tags, 2 * lines + 3 * c->S * c->valid_words) < 0 ||
+       snap_get_words(fp, c->set_state, c->S * c->state_words) < 0 || snap_get(fp, &c->psel, sizeof(c->psel)) < 0)
+        return -1;
+    if(c->lru_list && snap_get(fp, c->next, (2 * lines + 3 * c->S) * sizeof(unsigned int)) < 0)
+        return -1;
+    if(c->hashed && snap_get(fp, c->slot, c->S * c->slots * sizeof(unsigned int)) < 0)
+        return -1;
+    return 0;
+}
+
+void free_cache(Cache* c) { //deallocate cache
+    free(c->tags);
+    free(c->set_state);
+    free(c->next);
+    free(c->slot);
+    c->tags = NULL;
+    c->set_state = NULL;
+    c->next = NULL;
+    c->slot = NULL;
+}
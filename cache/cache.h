@@ -0,0 +1,250 @@
+/*
+ * cache.h - Set-associative cache model used by csim
+ */
+
+#ifndef CACHELAB_CACHE_H
+#define CACHELAB_CACHE_H
+
+#include <stdio.h>
+
+/* Hits, misses and evictions of the sets one thread simulates */
+typedef struct {
+    unsigned long long hit, miss, evict;
+    unsigned long long invalidate;    //lines removed by a lower level
+    unsigned long long dirty_evict;   //evictions that had to write the line back
+    unsigned long long bytes_read;    //fetched from the next level
+    unsigned long long bytes_written; //written back or through to the next level
+    unsigned long long pf_issued, pf_useful; //prefetch fills, and those used in time
+    unsigned long long pf_late;       //demanded while the fill was in flight
+    unsigned long long pf_polluting;  //evicted a block demanded before their own use
+    unsigned long long pf_unused;     //evicted or dropped without being used
+    unsigned long long victim_hit, victim_miss; //misses a victim or miss cache served, and the rest
+    unsigned long long time_counter;  //clock of the sets being simulated
+} Counters;
+
+/* Outcome of access_cache */
+#define ACCESS_HIT 0
+#define ACCESS_MISS 1
+#define ACCESS_EVICT 2 //miss that replaced a valid line
+#define ACCESS_PREFETCH_HIT 3 //first hit on a prefetched line
+
+/* Result of fill_cache and invalidate_cache */
+#define LINE_NONE 0
+#define LINE_CLEAN 1
+#define LINE_DIRTY 2
+
+typedef struct cache Cache;
+
+/*
+ * Policy - A replacement policy. Lines are always filled into an empty
+ *     way first; victim is only asked for a way once the set is full.
+ *     Per-line state lives in Cache.age and per-set state in
+ *     Cache.set_state, which init allocates with alloc_set_state.
+ */
+typedef struct {
+    const char* name;
+    int parallel;  //all state is per set, so -j gives identical results
+    int list;      //keeps its order in the LRU lists for large sets
+    int (*init)(Cache* c);
+    void (*hit)(Cache* c, unsigned long long set_idx, int way, unsigned long long now);
+    int (*victim)(Cache* c, unsigned long long set_idx);
+    void (*fill)(Cache* c, unsigned long long set_idx, int way, unsigned long long now);
+} Policy;
+
+/*
+ * Cache - All lines of the cache in one allocation, structure-of-arrays:
+ *     the tags of a set are contiguous (padded to a multiple of
+ *     SIMD_WAYS) so every way can be compared at once, validity is a
+ *     bitmask, and per-line policy state (last use for LRU) lives in its
+ *     own array.
+ */
+#define SIMD_WAYS 4
+
+/*
+ * Sets with at least LRU_LIST_WAYS lines find tags through a per-set
+ * open addressing hash instead of comparing every way. Policies that
+ * only reorder lines at the ends (LRU, FIFO, DIP) then also keep valid
+ * lines in an intrusive doubly linked list (MRU at the head) and empty
+ * ones on a free list threaded through next, so an access is O(1).
+ */
+#ifndef LRU_LIST_WAYS
+#define LRU_LIST_WAYS 32
+#endif
+#define NIL 0xffffffffu
+
+struct cache {
+    int s, E, b;
+    unsigned long long S;       //number of sets
+    int ways;                   //E rounded up to SIMD_WAYS
+    int valid_words;            //64-bit valid words per set
+    unsigned long long* tags;   //S * ways tags
+    unsigned long long* age;    //S * ways per-line policy state
+    unsigned long long* valid;  //S * valid_words bitmasks
+    unsigned long long* dirty;  //S * valid_words bitmasks
+    unsigned long long* prefetched; //S * valid_words bitmasks of lines not used since prefetched
+    int write_back;             //stores only dirty the line, else write through
+    int write_allocate;         //store misses fill the line, else bypass it
+
+    const Policy* policy;
+    unsigned long long seed;    //seeds the per-set random generators
+    unsigned long long* set_state; //S * state_words per-set policy state
+    int state_words;
+    int psel;                   //DIP set-dueling selector
+
+    int hashed;                 //find tags through slot
+    int lru_list;               //keep order in the lists below
+    unsigned int* next;         //S * ways links towards the LRU end
+    unsigned int* prev;         //S * ways links towards the MRU end
+    unsigned int* head;         //S most recently used ways
+    unsigned int* tail;         //S least recently used ways
+    unsigned int* free_head;    //S first empty ways
+    unsigned int* slot;         //S * slots way + 1 of each tag, 0 if empty
+    unsigned int slots;         //hash slots per set, a power of two >= 2E
+};
+
+/* policies - All replacement policies, NULL terminated */
+extern const Policy* const policies[];
+
+/* find_policy - Look a policy up by name, NULL if there is none */
+const Policy* find_policy(const char* name);
+
+/*
+ * init_cache - Allocate a cache of 2^s sets of E lines of 2^b bytes,
+ *     write-back and write-allocate until write_back and write_allocate
+ *     are changed. Returns -1 if the policy cannot model this geometry.
+ */
+int init_cache(Cache* c, int s, int E, int b, const Policy* policy, unsigned long long seed);
+
+/*
+ * access_cache - Simulate one load, or a store of size bytes if write is
+ *     set, counting it and the traffic to the next level in cnt. Returns
+ *     ACCESS_HIT, ACCESS_PREFETCH_HIT, ACCESS_MISS or ACCESS_EVICT; on
+ *     ACCESS_EVICT the address of the replaced block is stored in victim
+ *     if non-NULL.
+ */
+int access_cache(Cache* c, Counters* cnt, unsigned long long address, int write, int size,
+                 unsigned long long* victim);
+
+/*
+ * lookup_cache - The first half of access_cache: count a hit or a miss
+ *     and update the policy on a hit, but do not fill on a miss.
+ *     Returns 1 on a hit.
+ */
+int lookup_cache(Cache* c, Counters* cnt, unsigned long long address);
+
+/*
+ * fill_cache - The second half of access_cache: bring a block in, dirty
+ *     if set (nothing happens if it is already present). If a valid line
+ *     was evicted its block is stored in victim and LINE_CLEAN or
+ *     LINE_DIRTY returned, otherwise LINE_NONE. Traffic is not counted.
+ */
+int fill_cache(Cache* c, Counters* cnt, unsigned long long address, int dirty, unsigned long long* victim);
+
+/*
+ * prefetch_cache - Fill a block that no access asked for yet, counting the
+ *     fill and its traffic. Returns -1 if it is already present, otherwise
+ *     like fill_cache.
+ */
+int prefetch_cache(Cache* c, Counters* cnt, unsigned long long address, unsigned long long* victim);
+
+/* probe_cache - 1 if the block holding address is present; changes nothing */
+int probe_cache(const Cache* c, unsigned long long address);
+
+/*
+ * write_cache - Apply a store to the block holding address if present:
+ *     a write-back cache marks it dirty. Returns 1 if present.
+ */
+int write_cache(Cache* c, unsigned long long address);
+
+/* invalidate_cache - Drop the block holding address. Returns its LINE_* state */
+int invalidate_cache(Cache* c, unsigned long long address);
+
+/* valid_lines - Number of lines holding a block; scans every set */
+unsigned long long valid_lines(const Cache* c);
+
+/*
+ * save_cache - Write every line and all policy state of c to fp.
+ *     Returns -1 on a write error.
+ */
+int save_cache(const Cache* c, FILE* fp);
+
+/*
+ * load_cache - Read what save_cache wrote into c, which init_cache must
+ *     have built with the same geometry and policy. Returns -1 if it
+ *     cannot be read.
+ */
+int load_cache(Cache* c, FILE* fp);
+
+/* free_cache - Deallocate a cache */
+void free_cache(Cache* c);
+
+/* alloc_set_state - Give every set words of zeroed policy state */
+int alloc_set_state(Cache* c, int words);
+
+/*
+ * set_index - Set index bits of an address
+ */
+static inline unsigned long long set_index(const Cache* c, unsigned long long address) {
+    if(c->b >= 64)
+        return 0;
+    return (address >> c->b) & (c->S - 1);
+}
+
+/*
+ * block_bytes - Bytes of a size byte access at address that lie in its
+ *     block, so an access covering several blocks can be split
+ */
+static inline int block_bytes(const Cache* c, unsigned long long address, int size) {
+    if(c->b >= 64)
+        return size;
+    unsigned long long left = (1ULL << c->b) - (address & ((1ULL << c->b) - 1));
+    return (unsigned long long)size < left ? size : (int)left;
+}
+
+/*
+ * list_unlink - Take a valid way off its set's recency list
+ */
+static inline void list_unlink(Cache* c, unsigned long long set_idx, unsigned int way) {
+    unsigned int* next = c->next + set_idx * c->ways;
+    unsigned int* prev = c->prev + set_idx * c->ways;
+    if(prev[way] == NIL)
+        c->head[set_idx] = next[way];
+    else
+        next[prev[way]] = next[way];
+    if(next[way] == NIL)
+        c->tail[set_idx] = prev[way];
+    else
+        prev[next[way]] = prev[way];
+}
+
+/*
+ * list_push_front - Link a way in as the most recently used line
+ */
+static inline void list_push_front(Cache* c, unsigned long long set_idx, unsigned int way) {
+    unsigned int* next = c->next + set_idx * c->ways;
+    unsigned int* prev = c->prev + set_idx * c->ways;
+    prev[way] = NIL;
+    next[way] = c->head[set_idx];
+    if(next[way] == NIL)
+        c->tail[set_idx] = way;
+    else
+        prev[next[way]] = way;
+    c->head[set_idx] = way;
+}
+
+/*
+ * list_push_back - Link a way in as the least recently used line
+ */
+static inline void list_push_back(Cache* c, unsigned long long set_idx, unsigned int way) {
+    unsigned int* next = c->next + set_idx * c->ways;
+    unsigned int* prev = c->prev + set_idx * c->ways;
+    next[way] = NIL;
+    prev[way] = c->tail[set_idx];
+    if(prev[way] == NIL)
+        c->head[set_idx] = way;
+    else
+        next[prev[way]] = way;
+    c->tail[set_idx] = way;
+}
+
+#endif /* CACHELAB_CACHE_H */
@@ -0,0 +1,176 @@
+/*
+ * capture.c - Native capture of the loads and stores to chosen memory
+ *
+ * The regions are protected so that every instruction touching them
+ * faults. The SIGSEGV handler records the faulting address, and the
+ * page fault error code says whether it was a load or a store. It then
+ * opens the page and sets the trap flag, so the instruction runs to
+ * completion and the SIGTRAP that follows closes the page again. That
+ * costs two signals per access. The code under test is left as it was
+ * compiled, so its addresses are real and nothing else is counted.
+ *
+ * An access is recorded as sizeof(int) bytes at the address of its
+ * first fault. Further faults of the same instruction within those bytes
+ * are the access crossing into the next page; any other is an access of
+ * its own, as when a movs loads from one region and stores to another. A
+ * read-modify-write instruction is recorded as a store, not as valgrind's
+ * 'M'. Only x86-64 Linux exposes the error code and trap flag this needs.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "capture.h"
+
+#if defined(__linux__) && defined(__x86_64__)
+#include <ucontext.h>
+
+#define TRAP_FLAG 0x100   //EFLAGS.TF: trap after the next instruction
+#define FAULT_WRITE 0x2   //page fault error code: the access was a store
+#define MAX_OPEN_PAGES 4  //pages one instruction can open
+
+static struct {
+    char* base;
+    size_t len;
+} regions[MAX_CAPTURE_REGIONS];
+static int nregions;
+static size_t page_size;
+static TraceRecord* records;
+static size_t records_cap, nrecords;
+static int overflow;
+static int too_many_pages; //an instruction needed more than MAX_OPEN_PAGES
+static char* open_pages[MAX_OPEN_PAGES];
+static int nopen;
+static volatile sig_atomic_t stepping; //between a fault and its trap
+static char* step_addr;                 //first fault of the stepped instruction
+static struct sigaction old_segv, old_trap;
+
+static int in_regions(const char* addr) {
+    for(int i = 0; i < nregions; ++i)
+        if(addr >= regions[i].base && addr < regions[i].base + regions[i].len)
+            return 1;
+    return 0;
+}
+
+static void segv_handler(int sig, siginfo_t* si, void* context) {
+    (void)sig;
+    ucontext_t* uc = context;
+    char* addr = si->si_addr;
+    if(!in_regions(addr)) { //a real fault: let it happen
+        sigaction(SIGSEGV, &old_segv, NULL);
+        return;
+    }
+    if(nopen == MAX_OPEN_PAGES) { //stop capturing, but let the program finish
+        too_many_pages = 1;
+        for(int i = 0; i < nregions; ++i)
+            mprotect(regions[i].base, regions[i].len, PROT_READ | PROT_WRITE);
+        return;
+    }
+    if(!stepping || addr < step_addr || addr >= step_addr + sizeof(int)) {
+        if(!stepping)
+            step_addr = addr;
+        if(nrecords < records_cap) {
+            TraceRecord* rec = &records[nrecords++];
+            rec->op = uc->uc_mcontext.gregs[REG_ERR] & FAULT_WRITE ? 'S' : 'L';
+            rec->address = (unsigned long long)addr;
+            rec->size = sizeof(int);
+            rec->core = 0;
+        }
+        else {
+            overflow = 1;
+        }
+    }
+    char* page = (char*)((unsigned long long)addr & ~(unsigned long long)(page_size - 1));
+    mprotect(page, page_size, PROT_READ | PROT_WRITE);
+    open_pages[nopen++] = page;
+    stepping = 1;
+    uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+static void trap_handler(int sig, siginfo_t* si, void* context) {
+    (void)sig;
+    (void)si;
+    ucontext_t* uc = context;
+    if(!stepping) { //not ours
+        sigaction(SIGTRAP, &old_trap, NULL);
+        raise(SIGTRAP);
+        return;
+    }
+    while(nopen > 0) {
+        char* page = open_pages[--nopen];
+        if(!too_many_pages)
+            mprotect(page, page_size, PROT_NONE);
+    }
+    stepping = 0;
+    uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+}
+
+int capture_start(void* const* bases, const size_t* sizes, int n, TraceRecord* buf, size_t cap) {
+    struct sigaction sa;
+    page_size = sysconf(_SC_PAGESIZE);
+    if(n > MAX_CAPTURE_REGIONS)
+        return -1;
+    for(int i = 0; i < n; ++i)
+        if((unsigned long long)bases[i] % page_size || sizes[i] % page_size)
+            return -1;
+    nregions = n;
+    for(int i = 0; i < n; ++i) {
+        regions[i].base = bases[i];
+        regions[i].len = sizes[i];
+    }
+    records = buf;
+    records_cap = cap;
+    nrecords = 0;
+    overflow = 0;
+    too_many_pages = 0;
+    nopen = 0;
+    stepping = 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_sigaction = segv_handler;
+    if(sigaction(SIGSEGV, &sa, &old_segv) < 0)
+        return -1;
+    sa.sa_sigaction = trap_handler;
+    if(sigaction(SIGTRAP, &sa, &old_trap) < 0) {
+        sigaction(SIGSEGV, &old_segv, NULL);
+        return -1;
+    }
+    for(int i = 0; i < n; ++i) {
+        if(mprotect(regions[i].base, regions[i].len, PROT_NONE) < 0) {
+            capture_stop();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+long capture_stop(void) {
+    for(int i = 0; i < nregions; ++i)
+        mprotect(regions[i].base, regions[i].len, PROT_READ | PROT_WRITE);
+    nregions = 0;
+    sigaction(SIGSEGV, &old_segv, NULL);
+    sigaction(SIGTRAP, &old_trap, NULL);
+    if(too_many_pages)
+        return -2;
+    return overflow ? -1 : (long)nrecords;
+}
+
+#else
+
+int capture_start(void* const* bases, const size_t* sizes, int n, TraceRecord* buf, size_t cap) {
+    (void)bases;
+    (void)sizes;
+    (void)n;
+    (void)buf;
+    (void)cap;
+    return -1;
+}
+
+long capture_stop(void) {
+    return -1;
+}
+
+#endif
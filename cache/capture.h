@@ -0,0 +1,30 @@
+/*
+ * capture.h - Native capture of the loads and stores to chosen memory
+ */
+
+#ifndef CACHELAB_CAPTURE_H
+#define CACHELAB_CAPTURE_H
+
+#include <stddef.h>
+#include "trace.h"
+
+#define MAX_CAPTURE_REGIONS 4
+
+/*
+ * capture_start - Record every load and store the process makes to the
+ *     n regions from now until capture_stop, at most cap of them into
+ *     buf, in program order. Each region must start on a page boundary
+ *     and span whole pages. Returns -1 if capture is not supported on
+ *     this platform or the regions cannot be protected.
+ */
+int capture_start(void* const* regions, const size_t* sizes, int n, TraceRecord* buf, size_t cap);
+
+/*
+ * capture_stop - Stop recording and leave the regions accessible.
+ *     Returns the number of accesses recorded, -1 if there were more
+ *     than cap, or -2 if one instruction touched more pages of them than
+ *     capture can open at once; it stopped recording there.
+ */
+long capture_stop(void);
+
+#endif /* CACHELAB_CAPTURE_H */
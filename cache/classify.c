@@ -0,0 +1,187 @@
+/*
+ * classify.c - 3C miss classification and per-set miss counts
+ *
+ * Every access also goes to a shadow fully associative LRU cache with as
+ * many lines as the real one (Hill and Smith, 1989). A miss of the real
+ * cache is
+ *   - compulsory if its block was never accessed before
+ *   - capacity if the shadow cache misses as well
+ *   - conflict if the shadow cache hits, so only the mapping of blocks
+ *     to sets lost it
+ * Misses, evictions and the three kinds are also counted per set, which
+ * shows which sets the conflicts pile up in.
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "classify.h"
+#include "snapshot.h"
+
+/* Per-set counters */
+enum { SET_MISS, SET_EVICT, SET_COMPULSORY, SET_CONFLICT, SET_FIELDS };
+
+struct classifier {
+    const Cache* c;
+    Cache shadow;
+    Counters shadow_counters;
+    unsigned long long compulsory, capacity, conflict;
+    unsigned long long* sets;    //S * SET_FIELDS counters
+    unsigned long long* seen;    //open addressing set of blocks + 1
+    size_t seen_cap, seen_count;
+    int seen_max;                //block ~0ULL has no +1 encoding
+};
+
+Classifier* classify_create(const Cache* c) {
+    if((unsigned long long)c->E * c->S > INT_MAX)
+        return NULL;
+    Classifier* cl = calloc(1, sizeof(Classifier));
+    if(!cl)
+        return NULL;
+    cl->c = c;
+    cl->sets = calloc(c->S * SET_FIELDS, sizeof(unsigned long long));
+    cl->seen_cap = 1024;
+    cl->seen = calloc(cl->seen_cap, sizeof(unsigned long long));
+    if(!cl->sets || !cl->seen || init_cache(&cl->shadow, 0, c->E * c->S, c->b, policies[0], 0) < 0) {
+        free(cl->sets);
+        free(cl->seen);
+        free(cl);
+        return NULL;
+    }
+    cl->shadow.write_back = c->write_back;
+    cl->shadow.write_allocate = c->write_allocate;
+    return cl;
+}
+
+static size_t hash_block(unsigned long long blk) {
+    blk ^= blk >> 33;
+    blk *= 0xff51afd7ed558ccdULL;
+    blk ^= blk >> 33;
+    return blk;
+}
+
+/*
+ * seen_insert - Add blk to the blocks accessed so far. Returns 1 if it
+ *     was not there.
+ */
+static int seen_insert(Classifier* cl, unsigned long long blk) {
+    if(blk == ~0ULL) {
+        int first = !cl->seen_max;
+        cl->seen_max = 1;
+        return first;
+    }
+    size_t mask = cl->seen_cap - 1;
+    size_t i = hash_block(blk) & mask;
+    while(cl->seen[i]) {
+        if(cl->seen[i] == blk + 1)
+            return 0;
+        i = (i + 1) & mask;
+    }
+    cl->seen[i] = blk + 1;
+    if(++cl->seen_count * 2 > cl->seen_cap) { //grow to keep probes short
+        size_t cap = cl->seen_cap * 2;
+        unsigned long long* seen = calloc(cap, sizeof(unsigned long long));
+        if(!seen) {
+            fprintf(stderr, "Unable to grow the set of accessed blocks\n");
+            exit(1);
+        }
+        for(size_t j = 0; j < cl->seen_cap; ++j) {
+            if(!cl->seen[j])
+                continue;
+            size_t k = hash_block(cl->seen[j] - 1) & (cap - 1);
+            while(seen[k])
+                k = (k + 1) & (cap - 1);
+            seen[k] = cl->seen[j];
+        }
+        free(cl->seen);
+        cl->seen = seen;
+        cl->seen_cap = cap;
+    }
+    return 1;
+}
+
+void classify_access(Classifier* cl, unsigned long long address, int write, int size, int outcome) {
+    unsigned long long blk = cl->c->b >= 64 ? 0 : address >> cl->c->b;
+    unsigned long long* set = cl->sets + set_index(cl->c, address) * SET_FIELDS;
+    int first = seen_insert(cl, blk);
+    int shadow = access_cache(&cl->shadow, &cl->shadow_counters, address, write, size, NULL);
+
+    if(outcome != ACCESS_MISS && outcome != ACCESS_EVICT)
+        return;
+    ++set[SET_MISS];
+    if(outcome == ACCESS_EVICT)
+        ++set[SET_EVICT];
+    if(first) {
+        ++cl->compulsory;
+        ++set[SET_COMPULSORY];
+    }
+    else if(shadow == ACCESS_MISS || shadow == ACCESS_EVICT) {
+        ++cl->capacity;
+    }
+    else {
+        ++cl->conflict;
+        ++set[SET_CONFLICT];
+    }
+}
+
+void classify_counts(const Classifier* cl, unsigned long long* compulsory,
+                     unsigned long long* capacity, unsigned long long* conflict) {
+    *compulsory = cl->compulsory;
+    *capacity = cl->capacity;
+    *conflict = cl->conflict;
+}
+
+void classify_write_sets(const Classifier* cl, FILE* fp) {
+    for(unsigned long long i = 0; i < cl->c->S; ++i) {
+        const unsigned long long* set = cl->sets + i * SET_FIELDS;
+        unsigned long long capacity = set[SET_MISS] - set[SET_COMPULSORY] - set[SET_CONFLICT];
+        fprintf(fp, "set:%llu misses:%llu evictions:%llu compulsory:%llu capacity:%llu conflict:%llu\n",
+                i, set[SET_MISS], set[SET_EVICT], set[SET_COMPULSORY], capacity, set[SET_CONFLICT]);
+    }
+}
+
+void classify_clear(Classifier* cl) {
+    cl->compulsory = cl->capacity = cl->conflict = 0;
+    memset(cl->sets, 0, cl->c->S * SET_FIELDS * sizeof(unsigned long long));
+}
+
+int classify_save(const Classifier* cl, FILE* fp) {
+    if(save_cache(&cl->shadow, fp) < 0 || snap_put(fp, &cl->shadow_counters, sizeof(Counters)) < 0 ||
+       snap_put(fp, &cl->compulsory, sizeof(cl->compulsory)) < 0 ||
+       snap_put(fp, &cl->capacity, sizeof(cl->capacity)) < 0 ||
+       snap_put(fp, &cl->conflict, sizeof(cl->conflict)) < 0 ||
+       snap_put_words(fp, cl->sets, cl->c->S * SET_FIELDS) < 0 ||
+       snap_put(fp, &cl->seen_cap, sizeof(cl->seen_cap)) < 0 ||
+       snap_put(fp, &cl->seen_count, sizeof(cl->seen_count)) < 0 ||
+       snap_put(fp, &cl->seen_max, sizeof(cl->seen_max)) < 0)
+        return -1;
+    return snap_put_words(fp, cl->seen, cl->seen_cap);
+}
+
+int classify_load(Classifier* cl, FILE* fp) {
+    size_t cap;
+    if(load_cache(&cl->shadow, fp) < 0 || snap_get(fp, &cl->shadow_counters, sizeof(Counters)) < 0 ||
+       snap_get(fp, &cl->compulsory, sizeof(cl->compulsory)) < 0 ||
+       snap_get(fp, &cl->capacity, sizeof(cl->capacity)) < 0 ||
+       snap_get(fp, &cl->conflict, sizeof(cl->conflict)) < 0 ||
+       snap_get_words(fp, cl->sets, cl->c->S * SET_FIELDS) < 0 || snap_get(fp, &cap, sizeof(cap)) < 0)
+        return -1;
+    if(!cap || (cap & (cap - 1))) //the table is a power of two
+        return -1;
+    unsigned long long* seen = calloc(cap, sizeof(unsigned long long));
+    if(!seen)
+        return -1;
+    free(cl->seen);
+    cl->seen = seen;
+    cl->seen_cap = cap;
+    if(snap_get(fp, &cl->seen_count, sizeof(cl->seen_count)) < 0 ||
+       snap_get(fp, &cl->seen_max, sizeof(cl->seen_max)) < 0)
+        return -1;
+    return snap_get_words(fp, cl->seen, cap);
+}
+
+void classify_free(Classifier* cl) {
+    free_cache(&cl->shadow);
+    free(cl->sets);
+    free(cl->seen);
+    free(cl);
+}
@@ -0,0 +1,48 @@
+/*
+ * classify.h - 3C miss classification and per-set miss counts
+ */
+
+#ifndef CACHELAB_CLASSIFY_H
+#define CACHELAB_CLASSIFY_H
+
+#include <stdio.h>
+#include "cache.h"
+
+typedef struct classifier Classifier;
+
+/*
+ * classify_create - Classify the misses of c against a fully associative
+ *     LRU cache of the same capacity and block size. Returns NULL if it
+ *     is too large to model.
+ */
+Classifier* classify_create(const Cache* c);
+
+/* classify_access - Account an access to c given the outcome access_cache returned */
+void classify_access(Classifier* cl, unsigned long long address, int write, int size, int outcome);
+
+/* classify_counts - Misses of each class so far */
+void classify_counts(const Classifier* cl, unsigned long long* compulsory,
+                     unsigned long long* capacity, unsigned long long* conflict);
+
+/*
+ * classify_write_sets - Write one "set:.. misses:.. evictions:..
+ *     compulsory:.. capacity:.. conflict:.." line per set to fp
+ */
+void classify_write_sets(const Classifier* cl, FILE* fp);
+
+/* classify_clear - Zero the counts but remember the blocks and shadow lines */
+void classify_clear(Classifier* cl);
+
+/* classify_save - Write the classifier's state to fp. Returns -1 on a write error. */
+int classify_save(const Classifier* cl, FILE* fp);
+
+/*
+ * classify_load - Read what classify_save wrote into a classifier of a
+ *     cache with the same geometry. Returns -1 if it cannot be read.
+ */
+int classify_load(Classifier* cl, FILE* fp);
+
+/* classify_free - Release the classifier */
+void classify_free(Classifier* cl);
+
+#endif /* CACHELAB_CLASSIFY_H */
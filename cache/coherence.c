@@ -0,0 +1,377 @@
+/*
+ * coherence.c - Private L1 caches kept coherent over a shared bus
+ *
+ * Each core has its own L1 from the cache model. Instead of having every
+ * cache snoop the bus, a directory keyed by block records which cores
+ * hold each block and which one owns it; that gives the same states and
+ * transfers a snooping MESI/MOESI bus would, without searching every L1.
+ *   - read miss   BusRd: a modified (or owned) copy supplies the data.
+ *                 Under MESI the modified line is written back and both
+ *                 copies become shared; under MOESI it becomes owned and
+ *                 memory stays stale. With no other copy the line is
+ *                 exclusive.
+ *   - write miss  BusRdX: like a read, but every other copy is invalidated
+ *                 and the line is modified
+ *   - write hit   exclusive lines become modified silently; shared and
+ *                 owned ones need a BusUpgr that invalidates the others
+ * A miss on a block this core lost to another core's write is a
+ * coherence miss. It is true sharing if it touches bytes written since
+ * the line was lost and false sharing otherwise, tracked in 64 chunks
+ * per block (bytes for blocks up to 64 bytes).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+
+/* Directory entry of one block */
+typedef struct {
+    int used;
+    unsigned long long block;
+    unsigned int sharers;      //cores holding it
+    unsigned int lost;         //cores a write invalidated that have not missed on it since
+    unsigned int touched;      //cores that ever accessed it
+    int owner;                 //core holding it modified, exclusive or owned, -1 if none
+    char state;                //'M', 'E' or 'O' of the owner
+    unsigned long long* written; //MAX_CORES chunk masks written since each core lost it
+    unsigned long long false_sharing, true_sharing, invalidations;
+} Block;
+
+struct coherence {
+    Protocol protocol;
+    int s, E, b;
+    const Policy* policy;
+    unsigned long long seed;
+    int cores;                 //caches created so far
+    Cache l1[MAX_CORES];
+    Counters counters[MAX_CORES];
+    CoherenceStats stats;      //all but the per-core hits, misses and evictions
+    Cache llc;
+    Block* dir;                //open addressing by block
+    size_t dir_cap, dir_count;
+};
+
+int parse_protocol(const char* arg, Protocol* protocol) {
+    if(strcmp(arg, "mesi") == 0)
+        *protocol = PROTO_MESI;
+    else if(strcmp(arg, "moesi") == 0)
+        *protocol = PROTO_MOESI;
+    else
+        return -1;
+    return 0;
+}
+
+/*
+ * add_core - Create the L1 of the next core. Returns -1 if the policy
+ *     cannot model the geometry.
+ */
+static int add_core(Coherence* co) {
+    Cache* c = &co->l1[co->cores];
+    if(init_cache(c, co->s, co->E, co->b, co->policy, co->seed + co->cores) < 0)
+        return -1;
+    ++co->cores;
+    return 0;
+}
+
+Coherence* coherence_create(Protocol protocol, int s, int E, int b, const Policy* policy,
+                            unsigned long long seed, const LevelConfig* llc) {
+    Coherence* co = calloc(1, sizeof(Coherence));
+    if(!co) {
+        fprintf(stderr, "Unable to allocate the coherent caches\n");
+        return NULL;
+    }
+    co->protocol = protocol;
+    co->s = s;
+    co->E = E;
+    co->b = b;
+    co->policy = policy;
+    co->seed = seed;
+    co->dir_cap = 1024;
+    co->dir = calloc(co->dir_cap, sizeof(Block));
+    if(!co->dir) {
+        fprintf(stderr, "Unable to allocate the coherence directory\n");
+        free(co);
+        return NULL;
+    }
+    if(add_core(co) < 0) { //the others have the same geometry
+        fprintf(stderr, "The %s policy cannot model %d-way sets\n", policy->name, E);
+        free(co->dir);
+        free(co);
+        return NULL;
+    }
+    if(llc) {
+        if(init_cache(&co->llc, llc->s, llc->E, llc->b, llc->policy, seed + MAX_CORES) < 0) {
+            fprintf(stderr, "The %s policy cannot model %d-way sets\n", llc->policy->name, llc->E);
+            coherence_free(co);
+            return NULL;
+        }
+        co->stats.llc = 1;
+    }
+    return co;
+}
+
+static size_t hash_block(unsigned long long blk) {
+    blk ^= blk >> 33;
+    blk *= 0xff51afd7ed558ccdULL;
+    blk ^= blk >> 33;
+    return blk;
+}
+
+/*
+ * find_block - The directory entry of blk, created empty if add is set
+ *     and it has none (otherwise NULL). Adding may move every entry.
+ */
+static Block* find_block(Coherence* co, unsigned long long blk, int add) {
+    size_t mask = co->dir_cap - 1;
+    size_t i = hash_block(blk) & mask;
+    while(co->dir[i].used) {
+        if(co->dir[i].block == blk)
+            return &co->dir[i];
+        i = (i + 1) & mask;
+    }
+    if(!add)
+        return NULL;
+    if((co->dir_count + 1) * 2 > co->dir_cap) { //grow to keep probes short
+        size_t cap = co->dir_cap * 2;
+        Block* dir = calloc(cap, sizeof(Block));
+        if(!dir) {
+            fprintf(stderr, "Unable to grow the coherence directory\n");
+            exit(1);
+        }
+        for(size_t j = 0; j < co->dir_cap; ++j) {
+            if(!co->dir[j].used)
+                continue;
+            size_t k = hash_block(co->dir[j].block) & (cap - 1);
+            while(dir[k].used)
+                k = (k + 1) & (cap - 1);
+            dir[k] = co->dir[j];
+        }
+        free(co->dir);
+        co->dir = dir;
+        co->dir_cap = cap;
+        return find_block(co, blk, add);
+    }
+    Block* e = &co->dir[i];
+    e->used = 1;
+    e->block = blk;
+    e->owner = -1;
+    ++co->dir_count;
+    return e;
+}
+
+/*
+ * chunk_mask - The chunks of its block that a size byte access at
+ *     address touches
+ */
+static unsigned long long chunk_mask(const Coherence* co, unsigned long long address, int size) {
+    int shift = co->b > 6 ? co->b - 6 : 0; //bytes per chunk
+    unsigned long long offset = co->b >= 64 ? address : address & ((1ULL << co->b) - 1);
+    unsigned long long first = offset >> shift;
+    unsigned long long last = (offset + (size > 1 ? size : 1) - 1) >> shift;
+    if(last > 63)
+        last = 63;
+    return (~0ULL >> (63 - last)) & (~0ULL << first);
+}
+
+/* llc_read - Fetch a block no other cache could supply */
+static void llc_read(Coherence* co, unsigned long long address) {
+    unsigned long long victim;
+    Counters* cnt = &co->stats.llc_counters;
+    if(!co->stats.llc || lookup_cache(&co->llc, cnt, address))
+        return;
+    cnt->bytes_read += 1ULL << co->llc.b;
+    if(fill_cache(&co->llc, cnt, address, 0, &victim) == LINE_DIRTY)
+        cnt->bytes_written += 1ULL << co->llc.b;
+}
+
+/* llc_write - Write an L1 line back; the LLC absorbs it if it holds the block */
+static void llc_write(Coherence* co, unsigned long long address) {
+    if(co->stats.llc && write_cache(&co->llc, address))
+        return;
+    co->stats.llc_counters.bytes_written += 1ULL << co->b;
+}
+
+/*
+ * invalidate_others - Take the block away from every core but core,
+ *     which is about to modify it
+ */
+static void invalidate_others(Coherence* co, Block* e, int core, unsigned long long address) {
+    for(int d = 0; d < co->cores; ++d) {
+        if(d == core || !(e->sharers >> d & 1))
+            continue;
+        invalidate_cache(&co->l1[d], address);
+        ++co->stats.core[d].invalidations;
+        ++e->invalidations;
+        e->lost |= 1u << d;
+        if(!e->written && !(e->written = calloc(MAX_CORES, sizeof(unsigned long long)))) {
+            fprintf(stderr, "Unable to allocate sharing state\n");
+            exit(1);
+        }
+        e->written[d] = 0;
+    }
+    e->sharers = 1u << core;
+    e->owner = core;
+    e->state = 'M';
+}
+
+/* evict - Drop core's copy of the block its L1 just replaced */
+static void evict(Coherence* co, int core, unsigned long long victim) {
+    Block* e = find_block(co, co->b >= 64 ? 0 : victim >> co->b, 0);
+    if(!e)
+        return;
+    e->sharers &= ~(1u << core);
+    if(e->owner == core) {
+        if(e->state == 'M' || e->state == 'O') {
+            ++co->stats.core[core].writebacks;
+            llc_write(co, victim);
+        }
+        e->owner = -1;
+    }
+}
+
+/*
+ * bus_miss - Bring the block into core's L1 with a BusRd, or a BusRdX if
+ *     write is set
+ */
+static void bus_miss(Coherence* co, Block* e, int core, unsigned long long address, int write,
+                     unsigned long long chunks) {
+    CoherenceStats* st = &co->stats;
+    if(e->lost >> core & 1) {
+        ++st->core[core].coherence_misses;
+        if(e->written[core] & chunks) {
+            ++st->true_sharing;
+            ++e->true_sharing;
+        }
+        else {
+            ++st->false_sharing;
+            ++e->false_sharing;
+        }
+        e->lost &= ~(1u << core);
+    }
+
+    int owner = e->owner;
+    if(owner >= 0 && (e->state == 'M' || e->state == 'O')) { //the owner supplies it
+        ++st->transfers;
+        if(!write && co->protocol == PROTO_MESI) {
+            ++st->core[owner].writebacks;
+            llc_write(co, address);
+            e->owner = -1;
+        }
+        else if(!write) {
+            e->state = 'O';
+        }
+    }
+    else {
+        llc_read(co, address);
+        if(!write)
+            e->owner = -1; //an exclusive copy is shared now
+    }
+
+    if(write) {
+        ++st->bus_read_exclusives;
+        invalidate_others(co, e, core, address);
+    }
+    else {
+        ++st->bus_reads;
+        if(!e->sharers) {
+            e->owner = core;
+            e->state = 'E';
+        }
+        e->sharers |= 1u << core;
+    }
+}
+
+/* access_block - coherence_access within one block */
+static void access_block(Coherence* co, int core, unsigned long long address, int write, int size) {
+    Block* e = find_block(co, co->b >= 64 ? 0 : address >> co->b, 1);
+    unsigned long long chunks = chunk_mask(co, address, size);
+    unsigned long long victim;
+
+    e->touched |= 1u << core;
+    if(!(e->sharers >> core & 1)) {
+        bus_miss(co, e, core, address, write, chunks);
+    }
+    else if(write && e->owner == core && e->state == 'E') {
+        e->state = 'M';
+    }
+    else if(write && !(e->owner == core && e->state == 'M')) {
+        ++co->stats.bus_upgrades;
+        invalidate_others(co, e, core, address);
+    }
+    if(write && e->written) { //bytes the cores that lost it will find changed
+        for(int d = 0; d < co->cores; ++d) {
+            if(e->lost >> d & 1)
+                e->written[d] |= chunks;
+        }
+    }
+    if(access_cache(&co->l1[core], &co->counters[core], address, write, size, &victim) == ACCESS_EVICT)
+        evict(co, core, victim);
+}
+
+void coherence_access(Coherence* co, int core, unsigned long long address, int write, int size) {
+    while(co->cores <= core) {
+        if(add_core(co) < 0) {
+            fprintf(stderr, "Unable to allocate the L1 of core %d\n", co->cores);
+            exit(1);
+        }
+    }
+    for(;;) {
+        int n = block_bytes(&co->l1[core], address, size);
+        access_block(co, core, address, write, n);
+        address += n;
+        size -= n;
+        if(size <= 0)
+            break;
+    }
+}
+
+void coherence_stats(const Coherence* co, CoherenceStats* stats) {
+    *stats = co->stats;
+    stats->cores = co->cores;
+    for(int d = 0; d < co->cores; ++d) {
+        stats->core[d].hits = co->counters[d].hit;
+        stats->core[d].misses = co->counters[d].miss;
+        stats->core[d].evictions = co->counters[d].evict;
+    }
+}
+
+/* hotter - Whether a should be listed before b */
+static int hotter(const Block* a, const HotLine* b) {
+    if(a->false_sharing != b->false_sharing)
+        return a->false_sharing > b->false_sharing;
+    return a->invalidations > b->invalidations;
+}
+
+int coherence_hot_lines(const Coherence* co, HotLine* lines, int n) {
+    int count = 0;
+    for(size_t i = 0; i < co->dir_cap; ++i) {
+        const Block* e = &co->dir[i];
+        if(!e->used || (!e->false_sharing && !e->invalidations))
+            continue;
+        int pos = count;
+        while(pos > 0 && hotter(e, &lines[pos - 1]))
+            --pos;
+        if(pos >= n)
+            continue;
+        if(count < n)
+            ++count;
+        memmove(&lines[pos + 1], &lines[pos], (count - 1 - pos) * sizeof(HotLine));
+        lines[pos].address = co->b >= 64 ? 0 : e->block << co->b;
+        lines[pos].false_sharing = e->false_sharing;
+        lines[pos].true_sharing = e->true_sharing;
+        lines[pos].invalidations = e->invalidations;
+        lines[pos].cores = __builtin_popcount(e->touched);
+    }
+    return count;
+}
+
+void coherence_free(Coherence* co) {
+    for(int d = 0; d < co->cores; ++d)
+        free_cache(&co->l1[d]);
+    if(co->stats.llc)
+        free_cache(&co->llc);
+    for(size_t i = 0; i < co->dir_cap; ++i)
+        free(co->dir[i].written);
+    free(co->dir);
+    free(co);
+}
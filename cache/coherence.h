@@ -0,0 +1,78 @@
+/*
+ * coherence.h - Private L1 caches kept coherent over a shared bus
+ */
+
+#ifndef CACHELAB_COHERENCE_H
+#define CACHELAB_COHERENCE_H
+
+#include "cache.h"
+#include "hier.h"
+
+#define MAX_CORES 32
+
+typedef enum {
+    PROTO_MESI = 0,  //a read of a modified line writes it back and shares it
+    PROTO_MOESI      //the modified line becomes owned and keeps supplying it
+} Protocol;
+
+/* Counters of one core's L1 */
+typedef struct {
+    unsigned long long hits, misses, evictions;
+    unsigned long long coherence_misses; //on blocks another core's write took away
+    unsigned long long invalidations;    //lines another core's write took away
+    unsigned long long writebacks;       //modified or owned data sent to the LLC
+} CoreStats;
+
+typedef struct {
+    int cores;                           //highest core that accessed + 1
+    CoreStats core[MAX_CORES];
+    unsigned long long bus_reads, bus_read_exclusives, bus_upgrades;
+    unsigned long long transfers;        //misses another cache supplied
+    unsigned long long true_sharing, false_sharing; //coherence misses by kind
+    int llc;                             //whether the counters below mean anything
+    Counters llc_counters;
+} CoherenceStats;
+
+/* A block that coherence misses kept coming back to */
+typedef struct {
+    unsigned long long address;
+    unsigned long long false_sharing, true_sharing, invalidations;
+    int cores;                           //cores that accessed it
+} HotLine;
+
+typedef struct coherence Coherence;
+
+/* parse_protocol - Parse mesi or moesi. Returns -1 if it is unknown. */
+int parse_protocol(const char* arg, Protocol* protocol);
+
+/*
+ * coherence_create - Model up to MAX_CORES private L1s of 2^s sets of E
+ *     lines of 2^b bytes, write-back and write-allocate, in front of a
+ *     shared non-inclusive LLC if llc is non-NULL. Returns NULL with a
+ *     message on stderr if they cannot be simulated.
+ */
+Coherence* coherence_create(Protocol protocol, int s, int E, int b, const Policy* policy,
+                            unsigned long long seed, const LevelConfig* llc);
+
+/*
+ * coherence_access - Simulate one load, or a store if write is set, of
+ *     size bytes by core (below MAX_CORES). Sizes always count here: an
+ *     access touches every block it covers, and which bytes it touches
+ *     tells true sharing from false sharing.
+ */
+void coherence_access(Coherence* co, int core, unsigned long long address, int write, int size);
+
+/* coherence_stats - Counters accumulated so far */
+void coherence_stats(const Coherence* co, CoherenceStats* stats);
+
+/*
+ * coherence_hot_lines - Store the at most n blocks with the most false
+ *     sharing misses (then invalidations) in lines, most first. Returns
+ *     how many were stored.
+ */
+int coherence_hot_lines(const Coherence* co, HotLine* lines, int n);
+
+/* coherence_free - Release the caches */
+void coherence_free(Coherence* co);
+
+#endif /* CACHELAB_COHERENCE_H */
@@ -0,0 +1,190 @@
+/*
+ * hier.c - Multi-level cache hierarchy built from the cache model
+ *
+ * An access looks L1 up first; each miss is passed to the next level
+ * before the block is filled on the way back up, so a level always sees
+ * the request before any victim the fill above it produces. Evictions
+ * are where the inclusion modes differ:
+ *   - an inclusive level invalidates every copy of its victim above it
+ *   - a level below which an exclusive level sits hands its victim down
+ *     to it; an exclusive level never fills on a miss and gives up a
+ *     line when it hits, since the line moves up into the level above
+ * Dirty data leaves a level when its line is evicted (write-back) or
+ * with every store (write-through) and stops at the first write-back
+ * level below that holds the block; bytes_read and bytes_written count
+ * the traffic between each level and the one below it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hier.h"
+
+static const char* const inclusion_names[] = {"nine", "inclusive", "exclusive"};
+
+const char* inclusion_name(Inclusion inclusion) {
+    return inclusion_names[inclusion];
+}
+
+int parse_level(const char* arg, LevelConfig* cfg) {
+    char buf[64];
+    char* field[5] = {NULL};
+    int n = 0;
+    if(strlen(arg) >= sizeof(buf))
+        return -1;
+    strcpy(buf, arg);
+    for(char* p = buf; p && n < 5; ++n) {
+        field[n] = p;
+        p = strchr(p, ':');
+        if(p)
+            *p++ = '\0';
+    }
+    if(n < 3)
+        return -1;
+    cfg->s = atoi(field[0]);
+    cfg->E = atoi(field[1]);
+    cfg->b = atoi(field[2]);
+    if(cfg->s < 0 || cfg->s > 40 || cfg->E <= 0 || cfg->b < 0 || cfg->b > 40)
+        return -1;
+    cfg->policy = policies[0];
+    if(n > 3 && !(cfg->policy = find_policy(field[3])))
+        return -1;
+    cfg->inclusion = INCL_NINE;
+    if(n > 4) {
+        int i;
+        for(i = 0; i < 3 && strcmp(field[4], inclusion_names[i]) != 0; ++i)
+            ;
+        if(i == 3)
+            return -1;
+        cfg->inclusion = i;
+    }
+    return 0;
+}
+
+int init_hierarchy(Hierarchy* h, const LevelConfig* cfg, int levels, unsigned long long seed) {
+    memset(h, 0, sizeof(Hierarchy));
+    if(levels > MAX_LEVELS) {
+        fprintf(stderr, "At most %d cache levels are supported\n", MAX_LEVELS);
+        return -1;
+    }
+    for(int i = 0; i < levels; ++i) {
+        h->inclusion[i] = i > 0 ? cfg[i].inclusion : INCL_NINE;
+        if(i > 0 && cfg[i].b < cfg[i - 1].b) {
+            fprintf(stderr, "L%d blocks are smaller than L%d blocks\n", i + 1, i);
+            return -1;
+        }
+        if(h->inclusion[i] == INCL_EXCLUSIVE && cfg[i].b != cfg[i - 1].b) {
+            fprintf(stderr, "Exclusive L%d must use the block size of L%d\n", i + 1, i);
+            return -1;
+        }
+        if(init_cache(&h->cache[i], cfg[i].s, cfg[i].E, cfg[i].b, cfg[i].policy, seed + i) < 0) {
+            fprintf(stderr, "The %s policy cannot model %d-way sets\n", cfg[i].policy->name, cfg[i].E);
+            return -1;
+        }
+        h->levels = i + 1;
+    }
+    return 0;
+}
+
+/*
+ * back_invalidate - Drop every block above level that lies inside the
+ *     block of level starting at victim. Returns 1 if any of them was
+ *     dirty, since its data now has to leave with the victim.
+ */
+static int back_invalidate(Hierarchy* h, int level, unsigned long long victim) {
+    int b = h->cache[level].b;
+    int dirty = 0;
+    for(int i = 0; i < level; ++i) {
+        int sub = b - h->cache[i].b;
+        for(unsigned long long off = 0; off < (1ULL << sub); ++off) {
+            int state = invalidate_cache(&h->cache[i], victim + (off << h->cache[i].b));
+            if(state != LINE_NONE)
+                ++h->counters[i].invalidate;
+            dirty |= state == LINE_DIRTY;
+        }
+    }
+    return dirty;
+}
+
+/*
+ * write_down - Send bytes stored at level (a dirty victim or a store
+ *     written through) towards memory. The first write-back level below
+ *     holding the block absorbs them; every level they pass counts them.
+ */
+static void write_down(Hierarchy* h, int level, unsigned long long address, unsigned long long bytes) {
+    h->counters[level].bytes_written += bytes;
+    for(int i = level + 1; i < h->levels; ++i) {
+        if(write_cache(&h->cache[i], address) && h->cache[i].write_back)
+            return;
+        h->counters[i].bytes_written += bytes;
+    }
+}
+
+/*
+ * evicted - Apply the inclusion rules to a block evicted from level and
+ *     write it back if it is dirty
+ */
+static void evicted(Hierarchy* h, int level, unsigned long long victim, int dirty) {
+    unsigned long long next_victim;
+    unsigned long long block = 1ULL << h->cache[level].b;
+    if(h->inclusion[level] == INCL_INCLUSIVE && back_invalidate(h, level, victim) && !dirty) {
+        dirty = 1; //written back on behalf of the level above
+        ++h->counters[level].dirty_evict;
+    }
+    if(level + 1 < h->levels && h->inclusion[level + 1] == INCL_EXCLUSIVE) { //moves down, dirty or not
+        h->counters[level].bytes_written += block;
+        int state = fill_cache(&h->cache[level + 1], &h->counters[level + 1], victim, dirty, &next_victim);
+        if(state != LINE_NONE)
+            evicted(h, level + 1, next_victim, state == LINE_DIRTY);
+    }
+    else if(dirty) {
+        write_down(h, level, victim, block);
+    }
+}
+
+/*
+ * access_level - Fetch the block holding address into level and the
+ *     levels below it. Returns 1 if an exclusive level handed up a dirty
+ *     line, which the level above has to fill as dirty.
+ */
+static int access_level(Hierarchy* h, int level, unsigned long long address) {
+    Cache* c = &h->cache[level];
+    Counters* cnt = &h->counters[level];
+    unsigned long long victim;
+    int dirty = 0;
+
+    if(lookup_cache(c, cnt, address)) {
+        if(h->inclusion[level] == INCL_EXCLUSIVE) //the line moves up
+            return invalidate_cache(c, address) == LINE_DIRTY;
+        return 0;
+    }
+    cnt->bytes_read += 1ULL << c->b;
+    if(level + 1 < h->levels)
+        dirty = access_level(h, level + 1, address);
+    if(h->inclusion[level] == INCL_EXCLUSIVE)
+        return dirty;
+    int state = fill_cache(c, cnt, address, dirty, &victim);
+    if(state != LINE_NONE)
+        evicted(h, level, victim, state == LINE_DIRTY);
+    return 0;
+}
+
+void access_hierarchy(Hierarchy* h, unsigned long long address, int write, int size) {
+    Cache* l1 = &h->cache[0];
+    if(!write) {
+        access_level(h, 0, address);
+        return;
+    }
+    if(!l1->write_allocate && !lookup_cache(l1, &h->counters[0], address)) {
+        write_down(h, 0, address, size);
+        return;
+    }
+    if(l1->write_allocate)
+        access_level(h, 0, address);
+    if(!write_cache(l1, address) || !l1->write_back)
+        write_down(h, 0, address, size);
+}
+
+void free_hierarchy(Hierarchy* h) {
+    for(int i = 0; i < h->levels; ++i)
+        free_cache(&h->cache[i]);
+}
@@ -0,0 +1,57 @@
+/*
+ * hier.h - Multi-level cache hierarchy built from the cache model
+ */
+
+#ifndef CACHELAB_HIER_H
+#define CACHELAB_HIER_H
+
+#include "cache.h"
+
+#define MAX_LEVELS 4
+
+/* How a level relates to the levels above it */
+typedef enum {
+    INCL_NINE = 0,  //non-inclusive non-exclusive: filled on misses, no back-invalidation
+    INCL_INCLUSIVE, //like NINE, but its evictions invalidate the block above
+    INCL_EXCLUSIVE  //only holds lines evicted from the level above
+} Inclusion;
+
+typedef struct {
+    int s, E, b;
+    const Policy* policy;
+    Inclusion inclusion; //ignored for L1
+} LevelConfig;
+
+typedef struct {
+    int levels;
+    Cache cache[MAX_LEVELS];
+    Counters counters[MAX_LEVELS];
+    Inclusion inclusion[MAX_LEVELS];
+} Hierarchy;
+
+/*
+ * parse_level - Parse "s:E:b[:policy[:inclusion]]" where inclusion is
+ *     nine, inclusive or exclusive. Returns -1 if it is malformed.
+ */
+int parse_level(const char* arg, LevelConfig* cfg);
+
+/* inclusion_name - Name of an inclusion mode as parse_level accepts it */
+const char* inclusion_name(Inclusion inclusion);
+
+/*
+ * init_hierarchy - Build levels L1..Ln from cfg. Block sizes may only
+ *     grow going down, and an exclusive level must use the block size of
+ *     the level above. Returns -1 with a message on stderr otherwise.
+ */
+int init_hierarchy(Hierarchy* h, const LevelConfig* cfg, int levels, unsigned long long seed);
+
+/*
+ * access_hierarchy - Simulate one load, or a store of size bytes if
+ *     write is set, starting at L1
+ */
+void access_hierarchy(Hierarchy* h, unsigned long long address, int write, int size);
+
+/* free_hierarchy - Deallocate every level */
+void free_hierarchy(Hierarchy* h);
+
+#endif /* CACHELAB_HIER_H */
@@ -0,0 +1,266 @@
+/*
+ * policy.c - Replacement policies for the cache model
+ *
+ *   lru    least recently used (the lab's policy)
+ *   fifo   first in, first out
+ *   random uniformly random victim, seeded per set
+ *   plru   tree pseudo-LRU, E must be a power of two
+ *   srrip  static re-reference interval prediction, 2-bit RRPVs
+ *   brrip  bimodal RRIP: distant insertion, 1/32 of fills intermediate
+ *   dip    dynamic insertion: LRU and bimodal insertion duel over
+ *          leader sets and a 10-bit PSEL counter picks for the rest
+ *   lfu    least frequently used, ties go to the lowest way
+ *
+ * Random choices come from a xorshift generator per set, seeded from
+ * the cache seed and the set index, so results do not depend on how
+ * sets are spread over threads.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+#define RRPV_MAX 3          //2-bit re-reference prediction values
+#define BIMODAL_ODDS 32     //bimodal policies insert 1 in 32 fills near MRU
+#define DUEL_PERIOD 32      //one LRU and one BIP leader per 32 sets
+#define PSEL_MAX 1023
+
+static unsigned long long splitmix(unsigned long long x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * set_random - Next value of the set's generator, kept in set_state[0]
+ */
+static unsigned long long set_random(Cache* c, unsigned long long set_idx) {
+    unsigned long long* x = &c->set_state[set_idx * c->state_words];
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+    return *x * 0x2545f4914f6cdd1dULL;
+}
+
+static int init_random_state(Cache* c, int words) {
+    if(alloc_set_state(c, words) < 0)
+        return -1;
+    for(unsigned long long set_idx = 0; set_idx < c->S; ++set_idx)
+        c->set_state[set_idx * words] = splitmix(c->seed ^ splitmix(set_idx)) | 1;
+    return 0;
+}
+
+/*
+ * oldest_way - Way with the smallest age, the first one on ties
+ */
+static int oldest_way(Cache* c, unsigned long long set_idx) {
+    const unsigned long long* age = c->age + set_idx * c->ways;
+    unsigned long long evict_time = -1;
+    int way = 0;
+    for(int i = 0; i < c->E; ++i) {
+        if(age[i] < evict_time) {
+            evict_time = age[i];
+            way = i;
+        }
+    }
+    return way;
+}
+
+static int tail_or_oldest(Cache* c, unsigned long long set_idx) {
+    return c->lru_list ? (int)c->tail[set_idx] : oldest_way(c, set_idx);
+}
+
+/* lru */
+static void lru_hit(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    if(c->lru_list) {
+        if(c->head[set_idx] != (unsigned int)way) {
+            list_unlink(c, set_idx, way);
+            list_push_front(c, set_idx, way);
+        }
+    }
+    else {
+        c->age[set_idx * c->ways + way] = now;
+    }
+}
+
+static void lru_fill(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    if(c->lru_list)
+        list_push_front(c, set_idx, way);
+    else
+        c->age[set_idx * c->ways + way] = now;
+}
+
+/* fifo */
+static void fifo_hit(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)c;
+    (void)set_idx;
+    (void)way;
+    (void)now;
+}
+
+/* random */
+static int random_init(Cache* c) {
+    return init_random_state(c, 1);
+}
+
+static int random_victim(Cache* c, unsigned long long set_idx) {
+    return set_random(c, set_idx) % c->E;
+}
+
+static void random_touch(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)c;
+    (void)set_idx;
+    (void)way;
+    (void)now;
+}
+
+/*
+ * plru - One bit per node of a binary tree over the ways, heap indexed
+ *     from 1, pointing at the half that holds the next victim
+ */
+static int plru_init(Cache* c) {
+    if(c->E & (c->E - 1))
+        return -1;
+    return alloc_set_state(c, (c->E + 63) / 64);
+}
+
+static void plru_touch(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)now;
+    unsigned long long* bits = c->set_state + set_idx * c->state_words;
+    unsigned int node = 1;
+    for(int lo = 0, size = c->E; size > 1; size /= 2) {
+        int half = size / 2;
+        if(way < lo + half) { //point away, to the right half
+            bits[node / 64] |= 1ULL << (node % 64);
+            node = 2 * node;
+        }
+        else {
+            bits[node / 64] &= ~(1ULL << (node % 64));
+            node = 2 * node + 1;
+            lo += half;
+        }
+    }
+}
+
+static int plru_victim(Cache* c, unsigned long long set_idx) {
+    const unsigned long long* bits = c->set_state + set_idx * c->state_words;
+    unsigned int node = 1;
+    int lo = 0;
+    for(int size = c->E; size > 1; size /= 2) {
+        if(bits[node / 64] >> (node % 64) & 1) {
+            node = 2 * node + 1;
+            lo += size / 2;
+        }
+        else {
+            node = 2 * node;
+        }
+    }
+    return lo;
+}
+
+/* srrip and brrip: age holds the re-reference prediction value */
+static void rrip_hit(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)now;
+    c->age[set_idx * c->ways + way] = 0;
+}
+
+static int rrip_victim(Cache* c, unsigned long long set_idx) {
+    unsigned long long* rrpv = c->age + set_idx * c->ways;
+    for(;;) {
+        for(int i = 0; i < c->E; ++i)
+            if(rrpv[i] >= RRPV_MAX)
+                return i;
+        for(int i = 0; i < c->E; ++i) //nobody is distant yet: age everyone
+            ++rrpv[i];
+    }
+}
+
+static void srrip_fill(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)now;
+    c->age[set_idx * c->ways + way] = RRPV_MAX - 1;
+}
+
+static void brrip_fill(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)now;
+    int near = set_random(c, set_idx) % BIMODAL_ODDS == 0;
+    c->age[set_idx * c->ways + way] = near ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+/*
+ * dip - LRU order with a choice of insertion position. Besides the
+ *     generator, set_state[1] counts down the ages handed to lines
+ *     inserted at the LRU end, which sit below every age derived from
+ *     the clock (DIP_MRU_BASE + now) and below earlier LRU insertions.
+ */
+#define DIP_MRU_BASE (1ULL << 62)
+
+static int dip_init(Cache* c) {
+    if(init_random_state(c, 2) < 0)
+        return -1;
+    for(unsigned long long set_idx = 0; set_idx < c->S; ++set_idx)
+        c->set_state[set_idx * 2 + 1] = DIP_MRU_BASE - 1;
+    c->psel = (PSEL_MAX + 1) / 2;
+    return 0;
+}
+
+static void dip_hit(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    lru_hit(c, set_idx, way, DIP_MRU_BASE + now);
+}
+
+static void dip_fill(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    unsigned long long period = c->S < DUEL_PERIOD ? c->S : DUEL_PERIOD;
+    unsigned long long duel = set_idx % period;
+    int bip;
+    if(duel == 0) { //LRU leader: its misses vote for BIP
+        bip = 0;
+        if(c->psel < PSEL_MAX)
+            ++c->psel;
+    }
+    else if(duel == period / 2) { //BIP leader
+        bip = 1;
+        if(c->psel > 0)
+            --c->psel;
+    }
+    else {
+        bip = c->psel > PSEL_MAX / 2;
+    }
+
+    if(!bip || set_random(c, set_idx) % BIMODAL_ODDS == 0) {
+        lru_fill(c, set_idx, way, DIP_MRU_BASE + now);
+    }
+    else if(c->lru_list) {
+        list_push_back(c, set_idx, way);
+    }
+    else {
+        c->age[set_idx * c->ways + way] = c->set_state[set_idx * 2 + 1]--;
+    }
+}
+
+/* lfu: age counts the accesses since the line was filled */
+static void lfu_hit(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)now;
+    ++c->age[set_idx * c->ways + way];
+}
+
+static void lfu_fill(Cache* c, unsigned long long set_idx, int way, unsigned long long now) {
+    (void)now;
+    c->age[set_idx * c->ways + way] = 1;
+}
+
+static const Policy lru = {"lru", 1, 1, NULL, lru_hit, tail_or_oldest, lru_fill};
+static const Policy fifo = {"fifo", 1, 1, NULL, fifo_hit, tail_or_oldest, lru_fill};
+static const Policy rnd = {"random", 1, 0, random_init, random_touch, random_victim, random_touch};
+static const Policy plru = {"plru", 1, 0, plru_init, plru_touch, plru_victim, plru_touch};
+static const Policy srrip = {"srrip", 1, 0, NULL, rrip_hit, rrip_victim, srrip_fill};
+static const Policy brrip = {"brrip", 1, 0, random_init, rrip_hit, rrip_victim, brrip_fill};
+static const Policy dip = {"dip", 0, 1, dip_init, dip_hit, tail_or_oldest, dip_fill};
+static const Policy lfu = {"lfu", 1, 0, NULL, lfu_hit, oldest_way, lfu_fill};
+
+const Policy* const policies[] = {&lru, &fifo, &rnd, &plru, &srrip, &brrip, &dip, &lfu, NULL};
+
+const Policy* find_policy(const char* name) {
+    for(int i = 0; policies[i]; ++i)
+        if(strcmp(policies[i]->name, name) == 0)
+            return policies[i];
+    return NULL;
+}
@@ -0,0 +1,325 @@
+/*
+ * prefetch.c - Hardware prefetcher models for the cache model
+ *
+ *   next    on a miss, or the first use of a prefetched line (tagged
+ *           prefetching), fetch the next degree blocks
+ *   stride  a table of streams keyed by 4KB region remembers the last
+ *           block and stride of each; after STRIDE_CONFIDENT repeats of
+ *           the same stride, fetch degree strides ahead
+ *   stream  Jouppi stream buffers: a miss allocates the least recently
+ *           used buffer and fills it with the degree blocks after the
+ *           miss. A later miss that finds its block in a buffer takes it
+ *           from there (a hit) and the buffer fetches one more block.
+ *
+ * Prefetched data arrives latency demand accesses after it is issued.
+ * The first access to a prefetched block is useful if the data is there
+ * and late otherwise; a late access still waits for the fill, so it is
+ * counted as a miss. A prefetch is polluting when the line it evicted is
+ * missed on again, which a direct mapped filter of the blocks evicted by
+ * prefetches detects (collisions make it an undercount).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+#include "snapshot.h"
+
+#define STRIDE_ENTRIES 64      //streams tracked by the stride prefetcher
+#define STRIDE_REGION_BITS 12  //one stream per 4KB region
+#define STRIDE_CONFIDENT 2     //repeats of a stride before it is trusted
+#define STREAM_BUFFERS 4
+#define INFLIGHT_MAX 256       //prefetches tracked until they arrive
+#define POLLUTION_ENTRIES 4096
+#define MAX_DEGREE 64
+
+typedef struct {
+    int valid;
+    unsigned long long region;
+    unsigned long long last;  //last block accessed
+    long long stride;         //in blocks
+    int confidence;
+} StrideEntry;
+
+/* Blocks first..first+count-1, with the time each one arrives */
+typedef struct {
+    unsigned long long first;
+    int count;
+    unsigned long long used;  //last demand access served or allocated
+    unsigned long long ready[MAX_DEGREE]; //ring indexed by block % degree
+} StreamBuffer;
+
+struct prefetcher {
+    PrefetchConfig cfg;
+    Cache* c;
+    unsigned long long now;   //demand accesses so far
+    StrideEntry stride[STRIDE_ENTRIES];
+    StreamBuffer stream[STREAM_BUFFERS];
+    unsigned long long inflight_block[INFLIGHT_MAX]; //FIFO of in-cache prefetches
+    unsigned long long inflight_ready[INFLIGHT_MAX];
+    int inflight_head, inflight_count;
+    unsigned long long pollution[POLLUTION_ENTRIES]; //evicted block + 1
+};
+
+static const char* const kind_names[] = {"next", "stride", "stream"};
+static const int default_degree[] = {1, 2, 4};
+
+const char* prefetch_name(PrefetchKind kind) {
+    return kind_names[kind];
+}
+
+int parse_prefetch(const char* arg, PrefetchConfig* cfg) {
+    const char* colon = strchr(arg, ':');
+    size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+    int i;
+    for(i = 0; i < 3 && (strlen(kind_names[i]) != len || strncmp(arg, kind_names[i], len) != 0); ++i)
+        ;
+    if(i == 3)
+        return -1;
+    cfg->kind = i;
+    cfg->degree = default_degree[i];
+    cfg->latency = 0;
+    if(colon) {
+        char* end;
+        cfg->degree = strtol(colon + 1, &end, 10);
+        if(end == colon + 1 || (*end && *end != ':'))
+            return -1;
+        if(*end == ':') {
+            const char* p = end + 1;
+            cfg->latency = strtol(p, &end, 10);
+            if(end == p || *end)
+                return -1;
+        }
+    }
+    if(cfg->degree < 1 || cfg->degree > MAX_DEGREE || cfg->latency < 0)
+        return -1;
+    return 0;
+}
+
+Prefetcher* prefetch_create(const PrefetchConfig* cfg, Cache* c) {
+    Prefetcher* pf = calloc(1, sizeof(Prefetcher));
+    if(!pf)
+        return NULL;
+    pf->cfg = *cfg;
+    pf->c = c;
+    return pf;
+}
+
+static inline unsigned long long block_of(const Prefetcher* pf, unsigned long long address) {
+    return pf->c->b >= 64 ? 0 : address >> pf->c->b;
+}
+
+static inline unsigned long long block_address(const Prefetcher* pf, unsigned long long blk) {
+    return pf->c->b >= 64 ? 0 : blk << pf->c->b;
+}
+
+static inline unsigned int pollution_slot(unsigned long long blk) {
+    blk ^= blk >> 29;
+    blk *= 0xbf58476d1ce4e5b9ULL;
+    return (blk ^ blk >> 32) % POLLUTION_ENTRIES;
+}
+
+/*
+ * inflight_expire - Forget the prefetches that have arrived. Ready times
+ *     are issued in order, so they sit at the head of the FIFO.
+ */
+static void inflight_expire(Prefetcher* pf) {
+    while(pf->inflight_count && pf->inflight_ready[pf->inflight_head] <= pf->now) {
+        pf->inflight_head = (pf->inflight_head + 1) % INFLIGHT_MAX;
+        --pf->inflight_count;
+    }
+}
+
+static int inflight_find(const Prefetcher* pf, unsigned long long blk) {
+    for(int i = 0; i < pf->inflight_count; ++i)
+        if(pf->inflight_block[(pf->inflight_head + i) % INFLIGHT_MAX] == blk)
+            return 1;
+    return 0;
+}
+
+/*
+ * issue - Prefetch blk into the cache unless it is already there
+ */
+static void issue(Prefetcher* pf, Counters* cnt, unsigned long long blk) {
+    unsigned long long victim;
+    int state = prefetch_cache(pf->c, cnt, block_address(pf, blk), &victim);
+    if(state < 0)
+        return;
+    if(state != LINE_NONE) {
+        unsigned long long vblk = block_of(pf, victim);
+        pf->pollution[pollution_slot(vblk)] = vblk + 1;
+    }
+    if(pf->cfg.latency > 0) {
+        if(pf->inflight_count == INFLIGHT_MAX) { //oldest one has arrived by now
+            pf->inflight_head = (pf->inflight_head + 1) % INFLIGHT_MAX;
+            --pf->inflight_count;
+        }
+        int tail = (pf->inflight_head + pf->inflight_count++) % INFLIGHT_MAX;
+        pf->inflight_block[tail] = blk;
+        pf->inflight_ready[tail] = pf->now + pf->cfg.latency;
+    }
+}
+
+/*
+ * stride_train - Update the region's stream; issue if its stride is confirmed
+ */
+static void stride_train(Prefetcher* pf, Counters* cnt, unsigned long long address) {
+    unsigned long long blk = block_of(pf, address);
+    unsigned long long region = address >> STRIDE_REGION_BITS;
+    StrideEntry* e = &pf->stride[region % STRIDE_ENTRIES];
+    if(!e->valid || e->region != region) {
+        *e = (StrideEntry){1, region, blk, 0, 0};
+        return;
+    }
+    long long delta = (long long)(blk - e->last);
+    if(delta == 0) //same block again
+        return;
+    if(delta == e->stride) {
+        if(e->confidence < STRIDE_CONFIDENT)
+            ++e->confidence;
+    }
+    else {
+        e->stride = delta;
+        e->confidence = 0;
+    }
+    e->last = blk;
+    if(e->confidence >= STRIDE_CONFIDENT)
+        for(int k = 1; k <= pf->cfg.degree; ++k)
+            issue(pf, cnt, blk + k * e->stride);
+}
+
+/*
+ * stream_push - Fetch the block after the buffer's last one
+ */
+static void stream_push(Prefetcher* pf, Counters* cnt, StreamBuffer* sb) {
+    unsigned long long blk = sb->first + sb->count++;
+    sb->ready[blk % pf->cfg.degree] = pf->now + pf->cfg.latency;
+    ++cnt->pf_issued;
+    cnt->bytes_read += 1ULL << pf->c->b;
+}
+
+/*
+ * stream_take - Remove blk from the buffer holding it, dropping the
+ *     blocks in front of it, and top the buffer up. Returns -1 if no
+ *     buffer holds blk, otherwise 1 if its data has not arrived yet.
+ */
+static int stream_take(Prefetcher* pf, Counters* cnt, unsigned long long blk) {
+    for(int i = 0; i < STREAM_BUFFERS; ++i) {
+        StreamBuffer* sb = &pf->stream[i];
+        if(blk - sb->first >= (unsigned long long)sb->count)
+            continue;
+        int late = sb->ready[blk % pf->cfg.degree] > pf->now;
+        cnt->pf_unused += blk - sb->first;
+        sb->count -= blk - sb->first + 1;
+        sb->first = blk + 1;
+        sb->used = pf->now;
+        while(sb->count < pf->cfg.degree)
+            stream_push(pf, cnt, sb);
+        return late;
+    }
+    return -1;
+}
+
+/*
+ * stream_allocate - Restart the least recently used buffer after blk
+ */
+static void stream_allocate(Prefetcher* pf, Counters* cnt, unsigned long long blk) {
+    StreamBuffer* sb = &pf->stream[0];
+    for(int i = 1; i < STREAM_BUFFERS; ++i)
+        if(pf->stream[i].used < sb->used)
+            sb = &pf->stream[i];
+    cnt->pf_unused += sb->count;
+    sb->first = blk + 1;
+    sb->count = 0;
+    sb->used = pf->now;
+    while(sb->count < pf->cfg.degree)
+        stream_push(pf, cnt, sb);
+}
+
+void prefetch_access(Prefetcher* pf, Counters* cnt, unsigned long long address, int write, int size) {
+    Cache* c = pf->c;
+    unsigned long long blk = block_of(pf, address);
+    ++pf->now;
+    inflight_expire(pf);
+
+    if(pf->cfg.kind == PF_STREAM && (!write || c->write_allocate) && !probe_cache(c, address)) {
+        int late = stream_take(pf, cnt, blk);
+        if(late >= 0) { //served by a stream buffer
+            if(fill_cache(c, cnt, address, write && c->write_back, NULL) == LINE_DIRTY)
+                cnt->bytes_written += 1ULL << c->b;
+            if(write && !c->write_back)
+                cnt->bytes_written += size;
+            if(late) {
+                ++cnt->miss;
+                ++cnt->pf_late;
+            }
+            else {
+                ++cnt->hit;
+                ++cnt->pf_useful;
+            }
+            return;
+        }
+    }
+
+    int outcome = access_cache(c, cnt, address, write, size, NULL);
+    int miss = outcome == ACCESS_MISS || outcome == ACCESS_EVICT;
+    if(outcome == ACCESS_PREFETCH_HIT) {
+        if(inflight_find(pf, blk)) { //the data is still on its way
+            --cnt->hit;
+            ++cnt->miss;
+            ++cnt->pf_late;
+        }
+        else {
+            ++cnt->pf_useful;
+        }
+    }
+    else if(miss) {
+        unsigned long long* seen = &pf->pollution[pollution_slot(blk)];
+        if(*seen == blk + 1) {
+            ++cnt->pf_polluting;
+            *seen = 0;
+        }
+    }
+
+    switch (pf->cfg.kind) {
+        case PF_NEXT_LINE:
+            if(miss || outcome == ACCESS_PREFETCH_HIT)
+                for(int k = 1; k <= pf->cfg.degree; ++k)
+                    issue(pf, cnt, blk + k);
+            break;
+        case PF_STRIDE:
+            stride_train(pf, cnt, address);
+            break;
+        case PF_STREAM:
+            if(miss)
+                stream_allocate(pf, cnt, blk);
+            break;
+    }
+}
+
+int prefetch_save(const Prefetcher* pf, FILE* fp) {
+    if(snap_put(fp, &pf->now, sizeof(pf->now)) < 0 || snap_put(fp, pf->stride, sizeof(pf->stride)) < 0 ||
+       snap_put(fp, pf->stream, sizeof(pf->stream)) < 0 ||
+       snap_put(fp, pf->inflight_block, sizeof(pf->inflight_block)) < 0 ||
+       snap_put(fp, pf->inflight_ready, sizeof(pf->inflight_ready)) < 0 ||
+       snap_put(fp, &pf->inflight_head, sizeof(pf->inflight_head)) < 0 ||
+       snap_put(fp, &pf->inflight_count, sizeof(pf->inflight_count)) < 0)
+        return -1;
+    return snap_put_words(fp, pf->pollution, POLLUTION_ENTRIES);
+}
+
+int prefetch_load(Prefetcher* pf, FILE* fp) {
+    if(snap_get(fp, &pf->now, sizeof(pf->now)) < 0 || snap_get(fp, pf->stride, sizeof(pf->stride)) < 0 ||
+       snap_get(fp, pf->stream, sizeof(pf->stream)) < 0 ||
+       snap_get(fp, pf->inflight_block, sizeof(pf->inflight_block)) < 0 ||
+       snap_get(fp, pf->inflight_ready, sizeof(pf->inflight_ready)) < 0 ||
+       snap_get(fp, &pf->inflight_head, sizeof(pf->inflight_head)) < 0 ||
+       snap_get(fp, &pf->inflight_count, sizeof(pf->inflight_count)) < 0)
+        return -1;
+    if(pf->inflight_head < 0 || pf->inflight_head >= INFLIGHT_MAX ||
+       pf->inflight_count < 0 || pf->inflight_count > INFLIGHT_MAX)
+        return -1;
+    return snap_get_words(fp, pf->pollution, POLLUTION_ENTRIES);
+}
+
+void prefetch_free(Prefetcher* pf) {
+    free(pf);
+}
@@ -0,0 +1,59 @@
+/*
+ * prefetch.h - Hardware prefetcher models for the cache model
+ */
+
+#ifndef CACHELAB_PREFETCH_H
+#define CACHELAB_PREFETCH_H
+
+#include <stdio.h>
+#include "cache.h"
+
+typedef enum {
+    PF_NEXT_LINE = 0, //the blocks after each miss
+    PF_STRIDE,        //a constant stride per 4KB region, once confirmed
+    PF_STREAM         //sequential blocks into stream buffers beside the cache
+} PrefetchKind;
+
+typedef struct {
+    PrefetchKind kind;
+    int degree;  //blocks fetched ahead, or the depth of each stream buffer
+    int latency; //demand accesses a prefetched block takes to arrive
+} PrefetchConfig;
+
+typedef struct prefetcher Prefetcher;
+
+/*
+ * parse_prefetch - Parse "kind[:degree[:latency]]" where kind is next,
+ *     stride or stream. Returns -1 if it is malformed.
+ */
+int parse_prefetch(const char* arg, PrefetchConfig* cfg);
+
+/* prefetch_name - Name of a prefetcher kind as parse_prefetch accepts it */
+const char* prefetch_name(PrefetchKind kind);
+
+/*
+ * prefetch_create - Attach a prefetcher to a cache. Returns NULL if it
+ *     cannot be allocated.
+ */
+Prefetcher* prefetch_create(const PrefetchConfig* cfg, Cache* c);
+
+/*
+ * prefetch_access - access_cache with the prefetcher watching: the
+ *     access trains it, prefetches it issues fill the cache (or a stream
+ *     buffer), and the pf_* counters of cnt judge them
+ */
+void prefetch_access(Prefetcher* pf, Counters* cnt, unsigned long long address, int write, int size);
+
+/* prefetch_save - Write the prefetcher's state to fp. Returns -1 on a write error. */
+int prefetch_save(const Prefetcher* pf, FILE* fp);
+
+/*
+ * prefetch_load - Read what prefetch_save wrote into a prefetcher of the
+ *     same configuration. Returns -1 if it cannot be read.
+ */
+int prefetch_load(Prefetcher* pf, FILE* fp);
+
+/* prefetch_free - Release a prefetcher */
+void prefetch_free(Prefetcher* pf);
+
+#endif /* CACHELAB_PREFETCH_H */
@@ -0,0 +1,311 @@
+/*
+ * report.c - Machine-readable statistics and interval time series
+ *
+ * JSON output is a single object whose "config" comes first and whose
+ * "intervals" are written as they end, so a long trace streams its time
+ * series instead of holding it. CSV is one table: the configuration is
+ * repeated on every row so runs can simply be concatenated, then the
+ * interval number (or "total"), the level (1.., or tlb1.. for TLB
+ * levels) and its counters. Counts of the whole run rather than of a
+ * level go on the rows of level 1, the estimated cycles and AMAT among
+ * them. The confidence intervals of a set sample only come with the
+ * totals.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "report.h"
+
+struct report {
+    FILE* fp;
+    ReportFormat format;
+    SimConfig cfg;
+    unsigned long long interval;
+    unsigned long long intervals;       //entries written so far
+    SimStats last;                      //totals at the end of the last one
+    unsigned long long lines[MAX_LEVELS]; //per level, for the occupancy
+    unsigned long long tlb_entries[MAX_TLB_LEVELS];
+    char config_csv[1024];              //leading columns of every row
+};
+
+/* The counters of a level as named in JSON and CSV */
+static const struct {
+    const char* name;
+    size_t offset;
+} level_fields[] = {
+    {"hits", offsetof(SimLevelStats, hits)},
+    {"misses", offsetof(SimLevelStats, misses)},
+    {"evictions", offsetof(SimLevelStats, evictions)},
+    {"invalidations", offsetof(SimLevelStats, invalidations)},
+    {"dirty_evictions", offsetof(SimLevelStats, dirty_evictions)},
+    {"bytes_read", offsetof(SimLevelStats, bytes_read)},
+    {"bytes_written", offsetof(SimLevelStats, bytes_written)},
+    {"prefetches", offsetof(SimLevelStats, pf_issued)},
+    {"prefetches_useful", offsetof(SimLevelStats, pf_useful)},
+    {"prefetches_late", offsetof(SimLevelStats, pf_late)},
+    {"prefetches_polluting", offsetof(SimLevelStats, pf_polluting)},
+    {"prefetches_unused", offsetof(SimLevelStats, pf_unused)},
+    {"victim_hits", offsetof(SimLevelStats, victim_hits)},
+    {"victim_misses", offsetof(SimLevelStats, victim_misses)},
+    {"valid_lines", offsetof(SimLevelStats, valid_lines)},
+};
+#define LEVEL_FIELDS (sizeof(level_fields) / sizeof(level_fields[0]))
+
+static unsigned long long field(const SimLevelStats* st, int i) {
+    return *(const unsigned long long*)((const char*)st + level_fields[i].offset);
+}
+
+int parse_format(const char* arg, ReportFormat* format) {
+    static const char* const names[] = {"text", "json", "csv"};
+    for(int i = 0; i < 3; ++i) {
+        if(strcmp(arg, names[i]) == 0) {
+            *format = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const char* policy_name(const SimConfig* cfg) {
+    return cfg->policy ? cfg->policy->name : policies[0]->name;
+}
+
+static void write_config_json(const Report* r) {
+    const SimConfig* cfg = &r->cfg;
+    fprintf(r->fp, "{\"config\":{\"s\":%d,\"E\":%d,\"b\":%d,\"policy\":\"%s\",\"seed\":%llu,",
+            cfg->s, cfg->E, cfg->b, policy_name(cfg), cfg->seed);
+    fprintf(r->fp, "\"write\":\"%s\",\"allocate\":\"%s\",\"split\":%s,\"lower\":[",
+            cfg->write_through ? "wt" : "wb", cfg->no_write_allocate ? "nwa" : "wa",
+            cfg->split ? "true" : "false");
+    for(int i = 0; i < cfg->nlower; ++i) {
+        const LevelConfig* lv = &cfg->lower[i];
+        fprintf(r->fp, "%s{\"s\":%d,\"E\":%d,\"b\":%d,\"policy\":\"%s\",\"inclusion\":\"%s\"}", i ? "," : "",
+                lv->s, lv->E, lv->b, lv->policy->name, inclusion_name(lv->inclusion));
+    }
+    fprintf(r->fp, "],\"prefetch\":");
+    if(cfg->prefetch)
+        fprintf(r->fp, "{\"kind\":\"%s\",\"degree\":%d,\"latency\":%d}",
+                prefetch_name(cfg->prefetch->kind), cfg->prefetch->degree, cfg->prefetch->latency);
+    else
+        fprintf(r->fp, "null");
+    fprintf(r->fp, ",\"victim\":");
+    if(cfg->victim)
+        fprintf(r->fp, "{\"kind\":\"%s\",\"entries\":%d}", victim_name(cfg->victim->kind), cfg->victim->entries);
+    else
+        fprintf(r->fp, "null");
+    fprintf(r->fp, ",\"tlb\":");
+    if(cfg->tlb) {
+        fprintf(r->fp, "{\"page\":%llu,\"levels\":[", 1ULL << cfg->tlb->page_bits);
+        for(int i = 0; i < cfg->tlb->levels; ++i)
+            fprintf(r->fp, "%s{\"entries\":%d,\"ways\":%d}", i ? "," : "", cfg->tlb->entries[i], cfg->tlb->ways[i]);
+        fprintf(r->fp, "]}");
+    }
+    else {
+        fprintf(r->fp, "null");
+    }
+    fprintf(r->fp, ",\"timing\":");
+    if(cfg->timing) {
+        fprintf(r->fp, "{\"latency\":[");
+        for(int i = 0; i <= cfg->nlower; ++i)
+            fprintf(r->fp, "%s%d", i ? "," : "", cfg->timing->latency[i]);
+        fprintf(r->fp, "],\"memory_latency\":%d,\"bandwidth\":%d,\"mshrs\":%d,\"window\":%d,\"width\":%d}",
+                cfg->timing->memory_latency, cfg->timing->bandwidth, cfg->timing->mshrs, cfg->timing->window,
+                cfg->timing->width);
+    }
+    else {
+        fprintf(r->fp, "null");
+    }
+    fprintf(r->fp, ",\"sample\":%g,\"classify\":%s,\"interval\":%llu}", cfg->sample > 0 ? cfg->sample : 1.0,
+            cfg->classify ? "true" : "false", r->interval);
+    if(r->interval)
+        fprintf(r->fp, ",\n\"intervals\":[");
+}
+
+static void format_config_csv(Report* r) {
+    const SimConfig* cfg = &r->cfg;
+    char lower[256] = "none";
+    char prefetch[64] = "none";
+    char victim[32] = "none";
+    char tlb[128] = "none";
+    char timing[128] = "none";
+    size_t len = 0;
+    for(int i = 0; i < cfg->nlower; ++i) {
+        const LevelConfig* lv = &cfg->lower[i];
+        len += snprintf(lower + len, sizeof(lower) - len, "%s%d:%d:%d:%s:%s", i ? ";" : "",
+                        lv->s, lv->E, lv->b, lv->policy->name, inclusion_name(lv->inclusion));
+    }
+    if(cfg->prefetch)
+        snprintf(prefetch, sizeof(prefetch), "%s:%d:%d", prefetch_name(cfg->prefetch->kind),
+                 cfg->prefetch->degree, cfg->prefetch->latency);
+    if(cfg->victim)
+        snprintf(victim, sizeof(victim), "%s:%d", victim_name(cfg->victim->kind), cfg->victim->entries);
+    if(cfg->tlb)
+        format_tlb(cfg->tlb, ';', tlb, sizeof(tlb));
+    if(cfg->timing)
+        format_timing(cfg->timing, cfg->nlower + 1, ';', timing, sizeof(timing));
+    snprintf(r->config_csv, sizeof(r->config_csv), "%d,%d,%d,%s,%llu,%s,%s,%d,%s,%s,%s,%s,%s,%g,%d",
+             cfg->s, cfg->E, cfg->b, policy_name(cfg), cfg->seed, cfg->write_through ? "wt" : "wb",
+             cfg->no_write_allocate ? "nwa" : "wa", cfg->split, lower, prefetch, victim, tlb, timing,
+             cfg->sample > 0 ? cfg->sample : 1.0, cfg->classify);
+}
+
+static void write_header_csv(const Report* r) {
+    fprintf(r->fp, "s,E,b,policy,seed,write,allocate,split,lower,prefetch,victim,tlb,timing,sample,classify,interval,records,level");
+    for(size_t i = 0; i < LEVEL_FIELDS; ++i)
+        fprintf(r->fp, ",%s", level_fields[i].name);
+    fprintf(r->fp, ",miss_rate,eviction_rate,occupancy,split_accesses,compulsory,capacity,conflict,"
+            "page_walks,walk_references,sampled_sets,hits_ci,misses_ci,evictions_ci,cycles,amat,mshr_merges,"
+            "mshr_stall_cycles,window_stall_cycles,dram_busy_cycles\n");
+}
+
+Report* report_open(FILE* fp, ReportFormat format, const SimConfig* cfg, unsigned long long interval) {
+    Report* r = calloc(1, sizeof(Report));
+    if(!r)
+        return NULL;
+    r->fp = fp;
+    r->format = format;
+    r->cfg = *cfg;
+    r->interval = interval;
+    r->lines[0] = (1ULL << cfg->s) * cfg->E;
+    for(int i = 0; i < cfg->nlower; ++i)
+        r->lines[i + 1] = (1ULL << cfg->lower[i].s) * cfg->lower[i].E;
+    for(int i = 0; cfg->tlb && i < cfg->tlb->levels; ++i)
+        r->tlb_entries[i] = cfg->tlb->entries[i];
+    if(format == REPORT_JSON) {
+        write_config_json(r);
+    }
+    else if(format == REPORT_CSV) {
+        format_config_csv(r);
+        write_header_csv(r);
+    }
+    return r;
+}
+
+static double ratio(unsigned long long n, unsigned long long d) {
+    return d ? (double)n / d : 0.0;
+}
+
+/*
+ * write_level - Write the counters of cache level lv, or TLB level lv if
+ *     tlb is set, in the report's format
+ */
+static void write_level(const Report* r, unsigned long long interval, unsigned long long records,
+                        const SimStats* st, int tlb, int lv) {
+    const SimLevelStats* ls = tlb ? &st->tlb[lv] : &st->level[lv];
+    unsigned long long accesses = ls->hits + ls->misses;
+    double miss_rate = ratio(ls->misses, accesses);
+    double eviction_rate = ratio(ls->evictions, accesses);
+    double occupancy = ratio(ls->valid_lines, tlb ? r->tlb_entries[lv] : r->lines[lv]);
+    int first = !tlb && lv == 0; //the row with the counts of the whole run
+    if(r->format == REPORT_TEXT) {
+        fprintf(r->fp, "interval:%llu records:%llu %s%d hits:%llu misses:%llu evictions:%llu"
+                " miss-rate:%.6f eviction-rate:%.6f occupancy:%.6f\n", interval, records, tlb ? "TLB" : "L",
+                lv + 1, ls->hits, ls->misses, ls->evictions, miss_rate, eviction_rate, occupancy);
+    }
+    else if(r->format == REPORT_JSON) {
+        fprintf(r->fp, "%s{", lv ? "," : "");
+        for(size_t i = 0; i < LEVEL_FIELDS; ++i)
+            fprintf(r->fp, "\"%s\":%llu,", level_fields[i].name, field(ls, i));
+        fprintf(r->fp, "\"miss_rate\":%.6f,\"eviction_rate\":%.6f,\"occupancy\":%.6f}",
+                miss_rate, eviction_rate, occupancy);
+    }
+    else {
+        if(interval)
+            fprintf(r->fp, "%s,%llu,%llu,%s%d", r->config_csv, interval, records, tlb ? "tlb" : "", lv + 1);
+        else
+            fprintf(r->fp, "%s,total,%llu,%s%d", r->config_csv, records, tlb ? "tlb" : "", lv + 1);
+        for(size_t i = 0; i < LEVEL_FIELDS; ++i)
+            fprintf(r->fp, ",%llu", field(ls, i));
+        fprintf(r->fp, ",%.6f,%.6f,%.6f,%llu,%llu,%llu,%llu,%llu,%llu", miss_rate, eviction_rate, occupancy,
+                first ? st->split_accesses : 0, first ? st->compulsory : 0, first ? st->capacity : 0,
+                first ? st->conflict : 0, first ? st->page_walks : 0, first ? st->walk_references : 0);
+        if(first && st->sampled_sets && !interval)
+            fprintf(r->fp, ",%llu,%.1f,%.1f,%.1f", st->sampled_sets, st->hits_ci, st->misses_ci, st->evictions_ci);
+        else
+            fprintf(r->fp, ",%llu,,,", first ? st->sampled_sets : 0);
+        fprintf(r->fp, ",%llu,%.4f,%llu,%llu,%llu,%llu\n", first ? st->cycles : 0,
+                first ? ratio(st->latency_cycles, st->timed_accesses) : 0.0, first ? st->mshr_merges : 0,
+                first ? st->mshr_stall_cycles : 0, first ? st->window_stall_cycles : 0,
+                first ? st->dram_busy_cycles : 0);
+    }
+}
+
+/*
+ * write_stats - Write the counters of one interval, or of the whole run
+ *     if interval is 0, in the report's format
+ */
+static void write_stats(const Report* r, unsigned long long interval, unsigned long long records,
+                        const SimStats* st) {
+    if(r->format == REPORT_JSON)
+        fprintf(r->fp, "\"records\":%llu,\"levels\":[", records);
+    for(int lv = 0; lv < st->levels; ++lv)
+        write_level(r, interval, records, st, 0, lv);
+    if(r->format == REPORT_JSON)
+        fprintf(r->fp, "],\"tlb\":[");
+    for(int lv = 0; lv < st->tlb_levels; ++lv)
+        write_level(r, interval, records, st, 1, lv);
+    if(r->format == REPORT_JSON)
+        fprintf(r->fp, "],\"split_accesses\":%llu,\"compulsory\":%llu,\"capacity\":%llu,\"conflict\":%llu,"
+                "\"page_walks\":%llu,\"walk_references\":%llu,\"sampled_sets\":%llu", st->split_accesses,
+                st->compulsory, st->capacity, st->conflict, st->page_walks, st->walk_references, st->sampled_sets);
+    if(r->format == REPORT_JSON)
+        fprintf(r->fp, ",\"cycles\":%llu,\"amat\":%.4f,\"mshr_merges\":%llu,\"mshr_stall_cycles\":%llu,"
+                "\"window_stall_cycles\":%llu,\"dram_busy_cycles\":%llu", st->cycles,
+                ratio(st->latency_cycles, st->timed_accesses), st->mshr_merges, st->mshr_stall_cycles,
+                st->window_stall_cycles, st->dram_busy_cycles);
+    if(r->format == REPORT_JSON && st->sampled_sets && !interval)
+        fprintf(r->fp, ",\"hits_ci\":%.1f,\"misses_ci\":%.1f,\"evictions_ci\":%.1f",
+                st->hits_ci, st->misses_ci, st->evictions_ci);
+}
+
+/*
+ * subtract_level - Turn the totals in st into the counts since last
+ */
+static void subtract_level(SimLevelStats* st, const SimLevelStats* last) {
+    for(size_t i = 0; i < LEVEL_FIELDS; ++i) {
+        if(level_fields[i].offset == offsetof(SimLevelStats, valid_lines))
+            continue; //a snapshot, not a count
+        *(unsigned long long*)((char*)st + level_fields[i].offset) -= field(last, i);
+    }
+}
+
+void report_interval(Report* r, unsigned long long records, const SimStats* stats) {
+    SimStats delta = *stats;
+    for(int lv = 0; lv < stats->levels; ++lv)
+        subtract_level(&delta.level[lv], &r->last.level[lv]);
+    for(int lv = 0; lv < stats->tlb_levels; ++lv)
+        subtract_level(&delta.tlb[lv], &r->last.tlb[lv]);
+    delta.split_accesses -= r->last.split_accesses;
+    delta.compulsory -= r->last.compulsory;
+    delta.capacity -= r->last.capacity;
+    delta.conflict -= r->last.conflict;
+    delta.page_walks -= r->last.page_walks;
+    delta.walk_references -= r->last.walk_references;
+    delta.cycles -= r->last.cycles;
+    delta.timed_accesses -= r->last.timed_accesses;
+    delta.latency_cycles -= r->last.latency_cycles;
+    delta.mshr_merges -= r->last.mshr_merges;
+    delta.mshr_stall_cycles -= r->last.mshr_stall_cycles;
+    delta.window_stall_cycles -= r->last.window_stall_cycles;
+    delta.dram_busy_cycles -= r->last.dram_busy_cycles;
+
+    ++r->intervals;
+    if(r->format == REPORT_JSON)
+        fprintf(r->fp, "%s\n{\"interval\":%llu,", r->intervals > 1 ? "," : "", r->intervals);
+    write_stats(r, r->intervals, records, &delta);
+    if(r->format == REPORT_JSON)
+        fprintf(r->fp, "}");
+    r->last = *stats;
+}
+
+void report_close(Report* r, unsigned long long records, const SimStats* stats) {
+    if(r->format == REPORT_JSON) {
+        fprintf(r->fp, "%s,\n", r->interval ? "\n]" : "");
+        write_stats(r, 0, records, stats);
+        fprintf(r->fp, "}\n");
+    }
+    else if(r->format == REPORT_CSV) {
+        write_stats(r, 0, records, stats);
+    }
+    free(r);
+}
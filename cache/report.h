@@ -0,0 +1,44 @@
+/*
+ * report.h - Machine-readable statistics and interval time series
+ */
+
+#ifndef CACHELAB_REPORT_H
+#define CACHELAB_REPORT_H
+
+#include <stdio.h>
+#include "sim.h"
+
+typedef enum {
+    REPORT_TEXT = 0, //csim's own lines; only intervals go through a Report
+    REPORT_JSON,     //one object: config, intervals, totals
+    REPORT_CSV       //one row per level per interval, then the totals
+} ReportFormat;
+
+typedef struct report Report;
+
+/* parse_format - Parse text, json or csv. Returns -1 if it is unknown. */
+int parse_format(const char* arg, ReportFormat* format);
+
+/*
+ * report_open - Start a report of a simulation of cfg on fp, with a
+ *     time series entry every interval trace records if interval > 0.
+ *     JSON and CSV write the configuration now. Returns NULL if it
+ *     cannot be allocated.
+ */
+Report* report_open(FILE* fp, ReportFormat format, const SimConfig* cfg, unsigned long long interval);
+
+/*
+ * report_interval - Record the end of an interval after records trace
+ *     records. stats holds the totals so far; each entry gets the
+ *     counters of its own interval, and the miss rate, eviction rate
+ *     and occupancy of every level.
+ */
+void report_interval(Report* r, unsigned long long records, const SimStats* stats);
+
+/*
+ * report_close - Write the totals (JSON and CSV only) and release the
+ *     report
+ */
+void report_close(Report* r, unsigned long long records, const SimStats* stats);
+
+#endif /* CACHELAB_REPORT_H */
@@ -0,0 +1,287 @@
+/*
+ * reuse.c - Reuse distance histograms and working-set sizes of a trace
+ *
+ * The reuse distance of a touch is the number of distinct blocks touched
+ * since the previous touch of its block; a fully associative LRU cache
+ * of C blocks hits exactly the touches whose distance is below C, so the
+ * histogram predicts the miss ratio of every such cache at once. Each
+ * block's latest touch is marked in a Fenwick tree indexed by time, and
+ * the distance is the number of marks after the block's own (Bennett
+ * and Kruskal, 1975), O(log n) per touch. Once the tree fills up, the
+ * marks are renumbered in order to the front, so memory follows the
+ * blocks of the trace rather than its length.
+ *
+ * Sampling follows SHARDS (Waldspurger et al., 2015): only blocks whose
+ * hash falls below rate * 2^24 are followed, their distances are scaled
+ * by 1 / rate, and so are the counts.
+ *
+ * The working set of a window is the number of distinct blocks among its
+ * last window touches, kept up to date with a ring of those touches and
+ * a count per block of its touches in the ring.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "reuse.h"
+
+#define REUSE_TREE_MIN (1 << 16)
+#define SAMPLE_BITS 24
+
+/* A followed block */
+typedef struct {
+    int used;
+    unsigned long long block;
+    size_t last;                 //tree slot of its latest touch
+    unsigned long long in_window; //touches among the ring's
+} ReuseBlock;
+
+struct reuse {
+    int b;
+    double rate;
+    unsigned long long threshold; //blocks hashing below it are followed
+    ReuseBlock* blocks;          //open addressing by block
+    size_t cap, count;
+    int* tree;                   //Fenwick tree over slots, 1-based
+    size_t tree_cap, now;        //slots, and the next one to use
+    unsigned long long accesses, sampled, cold;
+    unsigned long long hist[REUSE_BUCKETS];
+
+    unsigned long long window;
+    unsigned long long* ring;    //blocks of the last window touches
+    unsigned char* ring_followed; //whether each of them is followed
+    unsigned long long ring_pos;
+    unsigned long long ws;       //distinct followed blocks in the ring
+    double ws_sum;
+    unsigned long long ws_windows, ws_max;
+};
+
+static size_t hash_block(unsigned long long blk) {
+    blk ^= blk >> 33;
+    blk *= 0xff51afd7ed558ccdULL;
+    blk ^= blk >> 33;
+    return blk;
+}
+
+Reuse* reuse_create(int b, double rate, unsigned long long window) {
+    Reuse* r = calloc(1, sizeof(Reuse));
+    if(!r)
+        return NULL;
+    r->b = b;
+    r->rate = rate < 1 ? rate : 1;
+    r->threshold = (unsigned long long)(r->rate * (1 << SAMPLE_BITS));
+    r->cap = 1024;
+    r->blocks = calloc(r->cap, sizeof(ReuseBlock));
+    r->tree_cap = REUSE_TREE_MIN;
+    r->tree = calloc(r->tree_cap + 1, sizeof(int));
+    r->window = window;
+    if(window) {
+        r->ring = malloc(window * sizeof(*r->ring));
+        r->ring_followed = calloc(window, 1);
+    }
+    if(!r->blocks || !r->tree || (window && (!r->ring || !r->ring_followed))) {
+        reuse_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+/*
+ * find_block - The entry of blk, created if add is set and it has none
+ *     (otherwise NULL). Adding may move every entry.
+ */
+static ReuseBlock* find_block(Reuse* r, unsigned long long blk, int add) {
+    if(add && 2 * (r->count + 1) > r->cap) { //keep load under 1/2
+        size_t cap = 2 * r->cap;
+        ReuseBlock* blocks = calloc(cap, sizeof(ReuseBlock));
+        if(!blocks) {
+            fprintf(stderr, "Unable to grow the reuse distance table\n");
+            exit(1);
+        }
+        for(size_t i = 0; i < r->cap; ++i) {
+            if(!r->blocks[i].used)
+                continue;
+            size_t j = hash_block(r->blocks[i].block) & (cap - 1);
+            while(blocks[j].used)
+                j = (j + 1) & (cap - 1);
+            blocks[j] = r->blocks[i];
+        }
+        free(r->blocks);
+        r->blocks = blocks;
+        r->cap = cap;
+    }
+    size_t j = hash_block(blk) & (r->cap - 1);
+    while(r->blocks[j].used) {
+        if(r->blocks[j].block == blk)
+            return &r->blocks[j];
+        j = (j + 1) & (r->cap - 1);
+    }
+    if(!add)
+        return NULL;
+    ReuseBlock* e = &r->blocks[j];
+    e->used = 1;
+    e->block = blk;
+    e->last = r->tree_cap; //no touch yet
+    ++r->count;
+    return e;
+}
+
+static void tree_add(Reuse* r, size_t slot, int v) {
+    for(size_t i = slot + 1; i <= r->tree_cap; i += i & -i)
+        r->tree[i] += v;
+}
+
+/* tree_prefix - Marks in slots 0..slot */
+static unsigned long long tree_prefix(const Reuse* r, size_t slot) {
+    unsigned long long n = 0;
+    for(size_t i = slot + 1; i > 0; i -= i & -i)
+        n += r->tree[i];
+    return n;
+}
+
+static int by_last(const void* a, const void* b) {
+    size_t x = (*(ReuseBlock* const*)a)->last, y = (*(ReuseBlock* const*)b)->last;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * compact - Renumber the latest touches 0..count-1 in order, leaving at
+ *     least as many free slots as there are blocks
+ */
+static void compact(Reuse* r) {
+    ReuseBlock** order = malloc(r->count * sizeof(ReuseBlock*));
+    size_t cap = r->tree_cap;
+    while(cap < 2 * r->count)
+        cap *= 2;
+    int* tree = calloc(cap + 1, sizeof(int));
+    if(!order || !tree) {
+        fprintf(stderr, "Unable to grow the reuse distance tree\n");
+        exit(1);
+    }
+    size_t n = 0;
+    for(size_t i = 0; i < r->cap; ++i) {
+        if(r->blocks[i].used)
+            order[n++] = &r->blocks[i];
+    }
+    qsort(order, n, sizeof(ReuseBlock*), by_last);
+    for(size_t i = 0; i < n; ++i) {
+        order[i]->last = i;
+        tree[i + 1] = 1;
+    }
+    for(size_t i = 1; i <= cap; ++i) { //linear Fenwick build
+        size_t parent = i + (i & -i);
+        if(parent <= cap)
+            tree[parent] += tree[i];
+    }
+    free(order);
+    free(r->tree);
+    r->tree = tree;
+    r->tree_cap = cap;
+    r->now = n;
+}
+
+static int bucket(unsigned long long d) {
+    return d ? 64 - __builtin_clzll(d) : 0;
+}
+
+/*
+ * ring_touch - Slide the working-set window over a touch of blk
+ */
+static void ring_touch(Reuse* r, unsigned long long blk, int followed) {
+    unsigned long long pos = r->ring_pos;
+    if(r->accesses > r->window && r->ring_followed[pos]) { //the touch leaving the window
+        ReuseBlock* old = find_block(r, r->ring[pos], 0);
+        if(--old->in_window == 0)
+            --r->ws;
+    }
+    r->ring[pos] = blk;
+    r->ring_followed[pos] = followed;
+    r->ring_pos = pos + 1 == r->window ? 0 : pos + 1;
+    if(followed && find_block(r, blk, 0)->in_window++ == 0)
+        ++r->ws;
+    if(r->accesses >= r->window) {
+        r->ws_sum += r->ws;
+        ++r->ws_windows;
+        if(r->ws > r->ws_max)
+            r->ws_max = r->ws;
+    }
+}
+
+/*
+ * touch_block - Histogram the reuse distance of one touch of blk
+ */
+static void touch_block(Reuse* r, unsigned long long blk) {
+    int followed = r->rate >= 1 || (hash_block(blk) >> (64 - SAMPLE_BITS)) < r->threshold;
+    ++r->accesses;
+    if(followed) {
+        if(r->now == r->tree_cap)
+            compact(r);
+        ReuseBlock* e = find_block(r, blk, 1);
+        ++r->sampled;
+        if(e->last == r->tree_cap) {
+            ++r->cold;
+        }
+        else {
+            unsigned long long d = r->count - tree_prefix(r, e->last);
+            if(r->rate < 1)
+                d = d / r->rate;
+            ++r->hist[bucket(d)];
+            tree_add(r, e->last, -1);
+        }
+        tree_add(r, r->now, 1);
+        e->last = r->now++;
+    }
+    if(r->window)
+        ring_touch(r, blk, followed);
+}
+
+void reuse_access(Reuse* r, unsigned long long address, int size) {
+    unsigned long long last = size > 1 ? address + (size - 1) : address;
+    if(last < address) //wrapped past the top of memory
+        last = ~0ULL;
+    if(r->b >= 64) {
+        touch_block(r, 0);
+        return;
+    }
+    for(unsigned long long blk = address >> r->b; ; ++blk) {
+        touch_block(r, blk);
+        if(blk == last >> r->b)
+            break;
+    }
+}
+
+double reuse_working_set(const Reuse* r) {
+    return r->ws / r->rate;
+}
+
+void reuse_stats(const Reuse* r, ReuseStats* stats) {
+    memset(stats, 0, sizeof(ReuseStats));
+    stats->accesses = r->accesses;
+    stats->sampled = r->sampled;
+    stats->cold = r->cold / r->rate;
+    for(int k = 0; k < REUSE_BUCKETS; ++k)
+        stats->hist[k] = r->hist[k] / r->rate;
+    stats->window = r->window;
+    if(r->ws_windows) {
+        stats->ws_mean = r->ws_sum / r->ws_windows / r->rate;
+        stats->ws_max = r->ws_max / r->rate;
+    }
+}
+
+double reuse_miss_ratio(const ReuseStats* stats, int k) {
+    double total = stats->cold, misses = stats->cold;
+    for(int j = 0; j < REUSE_BUCKETS; ++j) {
+        total += stats->hist[j];
+        if(j > k) //every distance in bucket j is at least 2^k
+            misses += stats->hist[j];
+    }
+    return total > 0 ? misses / total : 0.0;
+}
+
+void reuse_free(Reuse* r) {
+    if(!r)
+        return;
+    free(r->blocks);
+    free(r->tree);
+    free(r->ring);
+    free(r->ring_followed);
+    free(r);
+}
@@ -0,0 +1,56 @@
+/*
+ * reuse.h - Reuse distance histograms and working-set sizes of a trace
+ */
+
+#ifndef CACHELAB_REUSE_H
+#define CACHELAB_REUSE_H
+
+#include <stdio.h>
+
+/* Histogram buckets: 0, then [2^(k-1), 2^k) for bucket k */
+#define REUSE_BUCKETS 65
+
+typedef struct reuse Reuse;
+
+typedef struct {
+    unsigned long long accesses;             //block touches, after splitting
+    unsigned long long sampled;              //of those, the ones measured
+    double cold;                             //first touches, scaled to all accesses
+    double hist[REUSE_BUCKETS];              //reuses by distance, scaled likewise
+    unsigned long long window;               //working-set window, 0 if none
+    double ws_mean, ws_max;                  //distinct blocks over every full window
+} ReuseStats;
+
+/*
+ * reuse_create - Measure reuse distances of 2^b byte blocks: the number
+ *     of distinct other blocks touched between two touches of a block.
+ *     A rate below 1 only follows blocks whose hash falls in that
+ *     fraction (SHARDS) and scales the results back up. window > 0 also
+ *     tracks the distinct blocks in the last window touches. Returns
+ *     NULL if it cannot be allocated.
+ */
+Reuse* reuse_create(int b, double rate, unsigned long long window);
+
+/*
+ * reuse_access - Touch every block an access of size bytes covers
+ *     (size <= 1 touches one)
+ */
+void reuse_access(Reuse* r, unsigned long long address, int size);
+
+/* reuse_working_set - Distinct blocks in the last window touches (estimated if sampled) */
+double reuse_working_set(const Reuse* r);
+
+/* reuse_stats - The histogram and working-set summary so far */
+void reuse_stats(const Reuse* r, ReuseStats* stats);
+
+/*
+ * reuse_miss_ratio - Miss ratio of a fully associative LRU cache of
+ *     2^k blocks predicted from the histogram; exact for such sizes when
+ *     nothing was sampled
+ */
+double reuse_miss_ratio(const ReuseStats* stats, int k);
+
+/* reuse_free - Release the analysis */
+void reuse_free(Reuse* r);
+
+#endif /* CACHELAB_REUSE_H */
@@ -0,0 +1,564 @@
+/*
+ * sim.c - Embeddable cache simulator
+ *
+ * Set sampling simulates only the sets whose hashed index falls below
+ * sample * 2^32, so a smaller sample is always a subset of a larger one
+ * and the same sets are picked on every run. A set's accesses do not
+ * depend on the other sets, so each sampled set behaves exactly as in
+ * the full simulation; the totals are scaled by sets / sampled sets, and
+ * the spread of the per-set counts gives their confidence intervals.
+ *
+ * A checkpoint holds a header, the configuration it was taken with as
+ * text, the caller's position and then every cache, counter and model
+ * in the order sim_setup builds them.
+ *
+ * The timing model is told which level served each access from which
+ * level's hits went up, or, if none did, whether the last level read
+ * from memory; a store that missed a no-write-allocate L1 did neither.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "classify.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "CSIMSNAP"
+#define SNAPSHOT_VERSION 1
+
+struct simulator {
+    SimConfig cfg;
+    PrefetchConfig prefetch;  //cfg.prefetch points here
+    VictimConfig victim;      //cfg.victim points here
+    TlbConfig tlb;            //cfg.tlb points here
+    TimingConfig timing;      //cfg.timing points here
+    Cache cache;              //single cache
+    Counters counters;
+    Hierarchy hier;           //levels > 0 with lower levels
+    Prefetcher* prefetcher;
+    Victim* buffer;
+    Classifier* classifier;
+    Tlb* translations;
+    Timing* clock;
+    unsigned long long split_accesses;
+    unsigned long long sample_threshold; //sets hashing below it are simulated
+    unsigned long long sampled_sets;
+    unsigned long long (*set_counts)[3]; //hits, misses, evictions of every sampled set
+};
+
+static inline unsigned long long set_hash(unsigned long long set_idx) {
+    set_idx += 0x9e3779b97f4a7c15ULL;
+    set_idx = (set_idx ^ (set_idx >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    set_idx = (set_idx ^ (set_idx >> 27)) * 0x94d049bb133111ebULL;
+    return (set_idx ^ (set_idx >> 31)) >> 32;
+}
+
+/*
+ * sample_sets - Pick the sampled sets and give them counters. Returns -1
+ *     with a message on stderr if the sample holds no set.
+ */
+static int sample_sets(Simulator* sim) {
+    sim->sample_threshold = (unsigned long long)(sim->cfg.sample * 4294967296.0);
+    for(unsigned long long i = 0; i < sim->cache.S; ++i)
+        sim->sampled_sets += set_hash(i) < sim->sample_threshold;
+    if(!sim->sampled_sets) {
+        fprintf(stderr, "A sample of %g of %llu sets holds none of them\n", sim->cfg.sample, sim->cache.S);
+        return -1;
+    }
+    sim->set_counts = calloc(sim->cache.S, sizeof(*sim->set_counts));
+    if(!sim->set_counts) {
+        fprintf(stderr, "Unable to allocate counters for %llu sets\n", sim->cache.S);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * sim_teardown - Release what sim_setup built and zero the counters
+ */
+static void sim_teardown(Simulator* sim) {
+    if(sim->hier.levels)
+        free_hierarchy(&sim->hier);
+    else
+        free_cache(&sim->cache);
+    if(sim->prefetcher)
+        prefetch_free(sim->prefetcher);
+    victim_free(sim->buffer);
+    if(sim->classifier)
+        classify_free(sim->classifier);
+    tlb_free(sim->translations);
+    timing_free(sim->clock);
+    free(sim->set_counts);
+    memset(&sim->hier, 0, sizeof(sim->hier));
+    memset(&sim->counters, 0, sizeof(sim->counters));
+    sim->prefetcher = NULL;
+    sim->buffer = NULL;
+    sim->classifier = NULL;
+    sim->translations = NULL;
+    sim->clock = NULL;
+    sim->split_accesses = 0;
+    sim->sampled_sets = 0;
+    sim->set_counts = NULL;
+}
+
+/*
+ * sim_setup - Build the caches described by sim->cfg with empty counters.
+ *     Returns -1 with a message on stderr, and nothing left allocated, if
+ *     they cannot be simulated.
+ */
+static int sim_setup(Simulator* sim) {
+    const SimConfig* cfg = &sim->cfg;
+    const Policy* policy = cfg->policy ? cfg->policy : policies[0];
+
+    if(cfg->tlb && !(sim->translations = tlb_create(cfg->tlb))) {
+        fprintf(stderr, "Unable to allocate the TLB\n");
+        goto fail;
+    }
+    if(cfg->nlower > 0) {
+        LevelConfig levels[MAX_LEVELS];
+        levels[0] = (LevelConfig){cfg->s, cfg->E, cfg->b, policy, INCL_NINE};
+        memcpy(levels + 1, cfg->lower, cfg->nlower * sizeof(LevelConfig));
+        if(init_hierarchy(&sim->hier, levels, cfg->nlower + 1, cfg->seed) < 0)
+            goto fail;
+        for(int i = 0; i < sim->hier.levels; ++i) {
+            sim->hier.cache[i].write_back = !cfg->write_through;
+            sim->hier.cache[i].write_allocate = !cfg->no_write_allocate;
+        }
+    }
+    else {
+        if(init_cache(&sim->cache, cfg->s, cfg->E, cfg->b, policy, cfg->seed) < 0) {
+            fprintf(stderr, "The %s policy cannot model %d-way sets\n", policy->name, cfg->E);
+            goto fail;
+        }
+        sim->cache.write_back = !cfg->write_through;
+        sim->cache.write_allocate = !cfg->no_write_allocate;
+    }
+    if(cfg->prefetch && !(sim->prefetcher = prefetch_create(cfg->prefetch, &sim->cache))) {
+        fprintf(stderr, "Unable to allocate the prefetcher\n");
+        goto fail;
+    }
+    if(cfg->victim && !(sim->buffer = victim_create(cfg->victim, &sim->cache))) {
+        fprintf(stderr, "Unable to allocate the %s cache\n", victim_name(cfg->victim->kind));
+        goto fail;
+    }
+    if(cfg->classify && !(sim->classifier = classify_create(&sim->cache))) {
+        fprintf(stderr, "Unable to allocate the shadow cache for miss classification\n");
+        goto fail;
+    }
+    if(cfg->sample > 0 && cfg->sample < 1 && sample_sets(sim) < 0)
+        goto fail;
+    if(cfg->timing && !(sim->clock = timing_create(cfg->timing, cfg->nlower + 1, cfg->b))) {
+        fprintf(stderr, "Unable to allocate the timing model\n");
+        goto fail;
+    }
+    return 0;
+
+fail:
+    sim_teardown(sim);
+    return -1;
+}
+
+Simulator* sim_create(const SimConfig* cfg) {
+    if(cfg->nlower < 0 || cfg->nlower > MAX_LEVELS - 1) {
+        fprintf(stderr, "At most %d cache levels are supported\n", MAX_LEVELS);
+        return NULL;
+    }
+    if(cfg->nlower > 0 && (cfg->prefetch || cfg->victim || cfg->classify)) {
+        fprintf(stderr, "Prefetchers, victim caches and miss classification only model a single cache\n");
+        return NULL;
+    }
+    if(cfg->sample > 0 && cfg->sample < 1 && (cfg->nlower > 0 || cfg->prefetch || cfg->victim || cfg->classify)) {
+        fprintf(stderr, "Set sampling only models a single cache without prefetchers, victim caches or miss classification\n");
+        return NULL;
+    }
+    if(cfg->timing && (cfg->prefetch || cfg->victim || cfg->tlb || (cfg->sample > 0 && cfg->sample < 1))) {
+        fprintf(stderr, "The timing model does not model prefetchers, victim caches, TLBs or set sampling\n");
+        return NULL;
+    }
+    if(cfg->prefetch && cfg->victim) {
+        fprintf(stderr, "Victim and miss caches do not model prefetching\n");
+        return NULL;
+    }
+    if(cfg->prefetch && cfg->classify) {
+        fprintf(stderr, "Miss classification does not model prefetching\n");
+        return NULL;
+    }
+    Simulator* sim = calloc(1, sizeof(Simulator));
+    if(!sim) {
+        fprintf(stderr, "Unable to allocate the simulator\n");
+        return NULL;
+    }
+    sim->cfg = *cfg;
+    if(cfg->prefetch) {
+        sim->prefetch = *cfg->prefetch;
+        sim->cfg.prefetch = &sim->prefetch;
+    }
+    if(cfg->victim) {
+        sim->victim = *cfg->victim;
+        sim->cfg.victim = &sim->victim;
+    }
+    if(cfg->tlb) {
+        sim->tlb = *cfg->tlb;
+        sim->cfg.tlb = &sim->tlb;
+    }
+    if(cfg->timing) {
+        sim->timing = *cfg->timing;
+        sim->cfg.timing = &sim->timing;
+    }
+    if(sim_setup(sim) < 0) {
+        free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+/* What the timing model needs from the counters around an access */
+typedef struct {
+    unsigned long long hits[MAX_LEVELS];
+    unsigned long long memory_read, memory_written; //by the last level
+} Traffic;
+
+static void traffic(const Simulator* sim, Traffic* t) {
+    int levels = sim->hier.levels ? sim->hier.levels : 1;
+    const Counters* cnt = sim->hier.levels ? sim->hier.counters : &sim->counters;
+    for(int i = 0; i < levels; ++i)
+        t->hits[i] = cnt[i].hit;
+    t->memory_read = cnt[levels - 1].bytes_read;
+    t->memory_written = cnt[levels - 1].bytes_written;
+}
+
+/*
+ * time_access - Pass an access to the timing model, given the traffic
+ *     before it was simulated
+ */
+static void time_access(Simulator* sim, unsigned long long address, int write, const Traffic* before) {
+    Traffic after;
+    int levels = sim->hier.levels ? sim->hier.levels : 1;
+    int level = 0;
+    traffic(sim, &after);
+    while(level < levels && after.hits[level] == before->hits[level])
+        ++level;
+    if(level == levels && after.memory_read == before->memory_read)
+        level = TIMING_AROUND;
+    timing_access(sim->clock, address, write, level, after.memory_read - before->memory_read,
+                  after.memory_written - before->memory_written);
+}
+
+/*
+ * sim_access - Simulate one load or store, as one access per block it
+ *     covers (and one translation per page) when sizes are honored
+ */
+static void sim_access(Simulator* sim, unsigned long long address, int size, int write) {
+    const Cache* l1 = sim->hier.levels ? &sim->hier.cache[0] : &sim->cache;
+    int n = sim->cfg.split ? block_bytes(l1, address, size) : size;
+    if(sim->translations)
+        tlb_access(sim->translations, address, sim->cfg.split ? size : 1);
+    if(n < size)
+        ++sim->split_accesses;
+    for(;;) {
+        Traffic before = {0};
+        if(sim->clock)
+            traffic(sim, &before);
+        if(sim->hier.levels) {
+            access_hierarchy(&sim->hier, address, write, n);
+        }
+        else if(sim->set_counts) {
+            unsigned long long set_idx = set_index(&sim->cache, address);
+            if(set_hash(set_idx) < sim->sample_threshold) {
+                int outcome = access_cache(&sim->cache, &sim->counters, address, write, n, NULL);
+                ++sim->set_counts[set_idx][outcome != ACCESS_HIT];
+                sim->set_counts[set_idx][2] += outcome == ACCESS_EVICT;
+            }
+        }
+        else if(sim->prefetcher) {
+            prefetch_access(sim->prefetcher, &sim->counters, address, write, n);
+        }
+        else {
+            int outcome = sim->buffer ? victim_access(sim->buffer, &sim->counters, address, write, n)
+                                      : access_cache(&sim->cache, &sim->counters, address, write, n, NULL);
+            if(sim->classifier)
+                classify_access(sim->classifier, address, write, n, outcome);
+        }
+        if(sim->clock)
+            time_access(sim, address, write, &before);
+        address += n;
+        size -= n;
+        if(size <= 0)
+            break;
+        n = block_bytes(l1, address, size);
+    }
+}
+
+void sim_access_batch(Simulator* sim, const unsigned long long* addrs, const char* ops,
+                      const int* sizes, size_t n) {
+    for(size_t i = 0; i < n; ++i) {
+        int size = sizes ? sizes[i] : 1;
+        switch (ops[i]) {
+            case 'M': //load, then store
+                sim_access(sim, addrs[i], size, 0);
+                sim_access(sim, addrs[i], size, 1);
+                break;
+            case 'L':
+                sim_access(sim, addrs[i], size, 0);
+                break;
+            case 'S':
+                sim_access(sim, addrs[i], size, 1);
+                break;
+        }
+    }
+}
+
+static void level_stats(const Counters* cnt, SimLevelStats* out) {
+    out->hits = cnt->hit;
+    out->misses = cnt->miss;
+    out->evictions = cnt->evict;
+    out->invalidations = cnt->invalidate;
+    out->dirty_evictions = cnt->dirty_evict;
+    out->bytes_read = cnt->bytes_read;
+    out->bytes_written = cnt->bytes_written;
+    out->pf_issued = cnt->pf_issued;
+    out->pf_useful = cnt->pf_useful;
+    out->pf_late = cnt->pf_late;
+    out->pf_polluting = cnt->pf_polluting;
+    out->pf_unused = cnt->pf_unused;
+    out->victim_hits = cnt->victim_hit;
+    out->victim_misses = cnt->victim_miss;
+}
+
+/*
+ * extrapolate - Scale L1's counters from the sampled sets to all of them,
+ *     with the 95% confidence half-width of the hits, misses and
+ *     evictions from the variance of the per-set counts
+ */
+static void extrapolate(const Simulator* sim, SimStats* stats) {
+    double sets = sim->cache.S, n = sim->sampled_sets, scale = sets / n;
+    double sum[3] = {0}, squares[3] = {0}, ci[3] = {0};
+    for(unsigned long long i = 0; i < sim->cache.S; ++i) {
+        if(set_hash(i) >= sim->sample_threshold)
+            continue;
+        for(int k = 0; k < 3; ++k) {
+            sum[k] += sim->set_counts[i][k];
+            squares[k] += (double)sim->set_counts[i][k] * sim->set_counts[i][k];
+        }
+    }
+    if(n > 1) {
+        for(int k = 0; k < 3; ++k) {
+            double variance = (squares[k] - sum[k] * sum[k] / n) / (n - 1);
+            ci[k] = 1.96 * sets * sqrt((1 - n / sets) * variance / n);
+        }
+    }
+    SimLevelStats* l1 = &stats->level[0];
+    unsigned long long* scaled[] = {&l1->hits, &l1->misses, &l1->evictions, &l1->dirty_evictions,
+                                    &l1->bytes_read, &l1->bytes_written, &l1->valid_lines};
+    for(size_t i = 0; i < sizeof(scaled) / sizeof(scaled[0]); ++i)
+        *scaled[i] = (unsigned long long)(*scaled[i] * scale + 0.5);
+    stats->sampled_sets = sim->sampled_sets;
+    stats->hits_ci = ci[0];
+    stats->misses_ci = ci[1];
+    stats->evictions_ci = ci[2];
+}
+
+void sim_stats(const Simulator* sim, SimStats* stats) {
+    memset(stats, 0, sizeof(SimStats));
+    if(sim->hier.levels) {
+        stats->levels = sim->hier.levels;
+        for(int i = 0; i < sim->hier.levels; ++i) {
+            level_stats(&sim->hier.counters[i], &stats->level[i]);
+            stats->level[i].valid_lines = valid_lines(&sim->hier.cache[i]);
+        }
+    }
+    else {
+        stats->levels = 1;
+        level_stats(&sim->counters, &stats->level[0]);
+        stats->level[0].valid_lines = valid_lines(&sim->cache);
+        if(sim->set_counts)
+            extrapolate(sim, stats);
+    }
+    stats->split_accesses = sim->split_accesses;
+    if(sim->classifier)
+        classify_counts(sim->classifier, &stats->compulsory, &stats->capacity, &stats->conflict);
+    if(sim->translations) {
+        TlbStats tlb;
+        tlb_stats(sim->translations, &tlb);
+        stats->tlb_levels = tlb.levels;
+        for(int i = 0; i < tlb.levels; ++i) {
+            level_stats(&tlb.counters[i], &stats->tlb[i]);
+            stats->tlb[i].valid_lines = tlb.valid[i];
+        }
+        stats->page_walks = tlb.walks;
+        stats->walk_references = tlb.walk_references;
+    }
+    if(sim->clock) {
+        TimingStats timing;
+        timing_stats(sim->clock, &timing);
+        stats->cycles = timing.cycles;
+        stats->timed_accesses = timing.accesses;
+        stats->latency_cycles = timing.latency;
+        stats->mshr_merges = timing.mshr_merges;
+        stats->mshr_stall_cycles = timing.mshr_stalls;
+        stats->window_stall_cycles = timing.window_stalls;
+        stats->dram_busy_cycles = timing.dram_busy;
+    }
+}
+
+int sim_write_sets(const Simulator* sim, FILE* fp) {
+    if(!sim->classifier)
+        return -1;
+    classify_write_sets(sim->classifier, fp);
+    return 0;
+}
+
+/*
+ * clear_counters - Zero cnt but keep the clock the policies age lines by
+ */
+static void clear_counters(Counters* cnt) {
+    unsigned long long now = cnt->time_counter;
+    memset(cnt, 0, sizeof(Counters));
+    cnt->time_counter = now;
+}
+
+void sim_clear_stats(Simulator* sim) {
+    for(int i = 0; i < sim->hier.levels; ++i)
+        clear_counters(&sim->hier.counters[i]);
+    clear_counters(&sim->counters);
+    if(sim->classifier)
+        classify_clear(sim->classifier);
+    if(sim->translations)
+        tlb_clear(sim->translations);
+    if(sim->clock)
+        timing_clear(sim->clock);
+    if(sim->set_counts)
+        memset(sim->set_counts, 0, sim->cache.S * sizeof(*sim->set_counts));
+    sim->split_accesses = 0;
+}
+
+/*
+ * describe - The configuration as text, which a checkpoint must match
+ */
+static void describe(const SimConfig* cfg, char* buf, size_t size) {
+    const Policy* policy = cfg->policy ? cfg->policy : policies[0];
+    size_t len = snprintf(buf, size, "%d:%d:%d:%s seed:%llu wt:%d nwa:%d split:%d classify:%d sample:%.17g",
+                          cfg->s, cfg->E, cfg->b, policy->name, cfg->seed, cfg->write_through,
+                          cfg->no_write_allocate, cfg->split, cfg->classify, cfg->sample);
+    for(int i = 0; i < cfg->nlower && len < size; ++i)
+        len += snprintf(buf + len, size - len, " L%d:%d:%d:%d:%s:%s", i + 2, cfg->lower[i].s, cfg->lower[i].E,
+                        cfg->lower[i].b, cfg->lower[i].policy->name, inclusion_name(cfg->lower[i].inclusion));
+    if(cfg->prefetch && len < size)
+        len += snprintf(buf + len, size - len, " prefetch:%s:%d:%d", prefetch_name(cfg->prefetch->kind),
+                        cfg->prefetch->degree, cfg->prefetch->latency);
+    if(cfg->victim && len < size)
+        len += snprintf(buf + len, size - len, " %s:%d", victim_name(cfg->victim->kind), cfg->victim->entries);
+    if(cfg->tlb && len < size) {
+        len += snprintf(buf + len, size - len, " tlb:");
+        if(len < size)
+            format_tlb(cfg->tlb, ',', buf + len, size - len);
+    }
+    if(cfg->timing && len < size) {
+        len += snprintf(buf + len, size - len, " timing:");
+        if(len < size)
+            format_timing(cfg->timing, cfg->nlower + 1, ',', buf + len, size - len);
+    }
+}
+
+int sim_save(const Simulator* sim, FILE* fp, unsigned long long position) {
+    char config[512];
+    unsigned int header[2] = {SNAPSHOT_VERSION, sizeof(Counters)};
+    unsigned int length;
+    describe(&sim->cfg, config, sizeof(config));
+    length = strlen(config);
+    if(snap_put(fp, SNAPSHOT_MAGIC, 8) < 0 || snap_put(fp, header, sizeof(header)) < 0 ||
+       snap_put(fp, &length, sizeof(length)) < 0 || snap_put(fp, config, length) < 0 ||
+       snap_put(fp, &position, sizeof(position)) < 0 ||
+       snap_put(fp, &sim->split_accesses, sizeof(sim->split_accesses)) < 0)
+        return -1;
+    if(sim->translations && tlb_save(sim->translations, fp) < 0)
+        return -1;
+    if(sim->clock && timing_save(sim->clock, fp) < 0)
+        return -1;
+    for(int i = 0; i < sim->hier.levels; ++i)
+        if(save_cache(&sim->hier.cache[i], fp) < 0 || snap_put(fp, &sim->hier.counters[i], sizeof(Counters)) < 0)
+            return -1;
+    if(sim->hier.levels)
+        return 0;
+    if(save_cache(&sim->cache, fp) < 0 || snap_put(fp, &sim->counters, sizeof(Counters)) < 0)
+        return -1;
+    if(sim->prefetcher && prefetch_save(sim->prefetcher, fp) < 0)
+        return -1;
+    if(sim->buffer && victim_save(sim->buffer, fp) < 0)
+        return -1;
+    if(sim->classifier && classify_save(sim->classifier, fp) < 0)
+        return -1;
+    if(sim->set_counts && snap_put_words(fp, sim->set_counts[0], sim->cache.S * 3) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * load_state - The body of sim_load after the header. Returns -1 if the
+ *     state cannot be read.
+ */
+static int load_state(Simulator* sim, FILE* fp) {
+    if(sim->translations && tlb_load(sim->translations, fp) < 0)
+        return -1;
+    if(sim->clock && timing_load(sim->clock, fp) < 0)
+        return -1;
+    for(int i = 0; i < sim->hier.levels; ++i)
+        if(load_cache(&sim->hier.cache[i], fp) < 0 || snap_get(fp, &sim->hier.counters[i], sizeof(Counters)) < 0)
+            return -1;
+    if(sim->hier.levels)
+        return 0;
+    if(load_cache(&sim->cache, fp) < 0 || snap_get(fp, &sim->counters, sizeof(Counters)) < 0)
+        return -1;
+    if(sim->prefetcher && prefetch_load(sim->prefetcher, fp) < 0)
+        return -1;
+    if(sim->buffer && victim_load(sim->buffer, fp) < 0)
+        return -1;
+    if(sim->classifier && classify_load(sim->classifier, fp) < 0)
+        return -1;
+    if(sim->set_counts && snap_get_words(fp, sim->set_counts[0], sim->cache.S * 3) < 0)
+        return -1;
+    return 0;
+}
+
+int sim_load(Simulator* sim, FILE* fp, unsigned long long* position) {
+    char magic[8], config[512], saved[512];
+    unsigned int header[2], length;
+    if(snap_get(fp, magic, 8) < 0 || memcmp(magic, SNAPSHOT_MAGIC, 8) != 0 ||
+       snap_get(fp, header, sizeof(header)) < 0 || header[0] != SNAPSHOT_VERSION || header[1] != sizeof(Counters)) {
+        fprintf(stderr, "Not a checkpoint of this simulator\n");
+        return -1;
+    }
+    describe(&sim->cfg, config, sizeof(config));
+    if(snap_get(fp, &length, sizeof(length)) < 0 || length >= sizeof(saved) || snap_get(fp, saved, length) < 0) {
+        fprintf(stderr, "The checkpoint is damaged\n");
+        return -1;
+    }
+    saved[length] = '\0';
+    if(strcmp(saved, config) != 0) {
+        fprintf(stderr, "The checkpoint was taken with another configuration: %s\n", saved);
+        return -1;
+    }
+    sim_reset(sim); //only the state read below may remain
+    if(snap_get(fp, position, sizeof(*position)) < 0 ||
+       snap_get(fp, &sim->split_accesses, sizeof(sim->split_accesses)) < 0 || load_state(sim, fp) < 0) {
+        fprintf(stderr, "The checkpoint is damaged\n");
+        sim_reset(sim);
+        return -1;
+    }
+    return 0;
+}
+
+void sim_reset(Simulator* sim) {
+    sim_teardown(sim);
+    if(sim_setup(sim) < 0) { //it was built from this configuration before
+        fprintf(stderr, "Unable to rebuild the simulator\n");
+        exit(1);
+    }
+}
+
+void sim_free(Simulator* sim) {
+    if(!sim)
+        return;
+    sim_teardown(sim);
+    free(sim);
+}
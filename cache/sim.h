@@ -0,0 +1,128 @@
+/*
+ * sim.h - Embeddable cache simulator
+ *
+ * A Simulator owns everything one simulated memory system needs: the
+ * cache or hierarchy, the optional prefetcher, victim cache, miss
+ * classifier, TLB and timing model, and the counters. Nothing is
+ * global, so any number of simulators can run in one process, and
+ * accesses are fed in batches so tools pay for one call per batch
+ * rather than per access.
+ *
+ *     SimConfig cfg = {0};
+ *     cfg.s = 5; cfg.E = 1; cfg.b = 5;
+ *     Simulator* sim = sim_create(&cfg);
+ *     sim_access_batch(sim, addrs, ops, NULL, n);
+ *     sim_stats(sim, &stats);
+ */
+
+#ifndef CACHELAB_SIM_H
+#define CACHELAB_SIM_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "cache.h"
+#include "hier.h"
+#include "prefetch.h"
+#include "victim.h"
+#include "tlb.h"
+#include "timing.h"
+
+/* Simulator configuration; all-zero fields give the lab's LRU cache */
+typedef struct {
+    int s, E, b;                  //L1 geometry
+    const Policy* policy;         //NULL for lru
+    unsigned long long seed;      //for randomized policies
+    int write_through;            //instead of write-back
+    int no_write_allocate;        //instead of write-allocate
+    int split;                    //honor sizes: one access per block covered
+    int nlower;                   //levels below L1
+    LevelConfig lower[MAX_LEVELS - 1];
+    const PrefetchConfig* prefetch; //NULL for none; single cache only
+    int classify;                 //3C classification; single cache only
+    const VictimConfig* victim;   //NULL for none; single cache only
+    const TlbConfig* tlb;         //NULL for none
+    double sample;                //fraction of sets simulated, 0 for all; single cache only
+    const TimingConfig* timing;   //NULL for none; not with prefetch, victim, tlb or sample
+} SimConfig;
+
+/* Counters of one level */
+typedef struct {
+    unsigned long long hits, misses, evictions, invalidations;
+    unsigned long long dirty_evictions, bytes_read, bytes_written;
+    unsigned long long pf_issued, pf_useful, pf_late, pf_polluting, pf_unused;
+    unsigned long long victim_hits, victim_misses; //misses the victim or miss cache served or not
+    unsigned long long valid_lines; //lines holding a block at the time
+} SimLevelStats;
+
+typedef struct {
+    int levels;
+    SimLevelStats level[MAX_LEVELS];
+    unsigned long long split_accesses;           //accesses covering several blocks
+    unsigned long long compulsory, capacity, conflict; //with classify
+    int tlb_levels;
+    SimLevelStats tlb[MAX_TLB_LEVELS];           //hits, misses and valid entries
+    unsigned long long page_walks, walk_references;
+    unsigned long long sampled_sets;             //sets simulated with sample, else 0
+    double hits_ci, misses_ci, evictions_ci;     //95% half-widths of L1's extrapolated counts
+    unsigned long long cycles;                   //estimated with timing, else 0
+    unsigned long long timed_accesses, latency_cycles; //AMAT is their ratio
+    unsigned long long mshr_merges, mshr_stall_cycles, window_stall_cycles, dram_busy_cycles;
+} SimStats;
+
+typedef struct simulator Simulator;
+
+/*
+ * sim_create - Build a simulator. Returns NULL with a message on stderr
+ *     if the configuration cannot be simulated.
+ */
+Simulator* sim_create(const SimConfig* cfg);
+
+/*
+ * sim_access_batch - Simulate n accesses in order. ops holds 'L', 'S' or
+ *     'M' (a load then a store) per access; sizes may be NULL, which is
+ *     only a loss with split or write-through.
+ */
+void sim_access_batch(Simulator* sim, const unsigned long long* addrs, const char* ops,
+                      const int* sizes, size_t n);
+
+/*
+ * sim_stats - Counters accumulated since creation or the last reset.
+ *     Counting the valid lines scans every set. With sample, L1's
+ *     counters are extrapolated from the sampled sets to all of them.
+ */
+void sim_stats(const Simulator* sim, SimStats* stats);
+
+/*
+ * sim_write_sets - Write the per-set miss counts of classify_write_sets.
+ *     Returns -1 if the simulator does not classify misses.
+ */
+int sim_write_sets(const Simulator* sim, FILE* fp);
+
+/*
+ * sim_clear_stats - Zero every counter but keep what the caches hold,
+ *     so the accesses so far only warmed them up
+ */
+void sim_clear_stats(Simulator* sim);
+
+/*
+ * sim_save - Write the whole state of the simulator to fp, along with
+ *     position (such as the trace records consumed so far). Returns -1 on
+ *     a write error.
+ */
+int sim_save(const Simulator* sim, FILE* fp, unsigned long long position);
+
+/*
+ * sim_load - Restore what sim_save wrote for a simulator of the same
+ *     configuration, and its position. Returns -1 with a message on
+ *     stderr if fp does not hold one, and resets sim if the state after
+ *     the header is damaged.
+ */
+int sim_load(Simulator* sim, FILE* fp, unsigned long long* position);
+
+/* sim_reset - Empty every cache and zero every counter */
+void sim_reset(Simulator* sim);
+
+/* sim_free - Release the simulator */
+void sim_free(Simulator* sim);
+
+#endif /* CACHELAB_SIM_H */
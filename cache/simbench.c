@@ -0,0 +1,256 @@
+/*
+ * simbench.c - Throughput benchmark of the cache simulator
+ *
+ * Generates each workload once into memory, then times the simulator
+ * alone over it for every geometry and policy, so the numbers move with
+ * the simulator and not with trace parsing or generation. Each
+ * combination runs several times on a fresh simulator and the fastest
+ * run counts, which keeps one noisy run from looking like a regression.
+ *
+ * Results are printed one combination per line; saved with -o they
+ * become a baseline that a later run compares itself to with -c,
+ * exiting with status 2 if any combination got slower than the
+ * tolerance allows.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "sim.h"
+#include "workload.h"
+
+#define MAX_ITEMS 32
+#define MAX_BASELINE 4096
+
+static const char* default_workloads[] = {
+    "seq:footprint=16M", "stride:footprint=16M,stride=4160", "uniform:footprint=16M,write=0.3",
+    "zipf:footprint=16M,alpha=0.9,write=0.3", "chase:footprint=16M", "matrix:dim=1024,tile=8"
+};
+static const char* default_geometries[] = {"5:1:5", "8:4:6", "10:16:6"};
+
+/* One line of a baseline */
+typedef struct {
+    char workload[128], geometry[32], policy[32];
+    double rate;
+} Result;
+
+/*
+ * usage - Print usage info
+ */
+void usage(char* argv[]) {
+    printf("Usage: %s [-h] [-n <num>] [-r <runs>] [-w <pattern>]... [-g <s:E:b>]... [-p <policy>]... [-o <file>] [-c <file> [-x <frac>]]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h            Print this help message.\n");
+    printf("  -n <num>      Accesses generated per workload (default 2M).\n");
+    printf("  -r <runs>     Runs per combination; the fastest counts (default 3).\n");
+    printf("  -w <pattern>  Workload, as after gen: in csim -t (default: one of each).\n");
+    printf("  -g <s:E:b>    Cache geometry (default 5:1:5, 8:4:6 and 10:16:6).\n");
+    printf("  -p <policy>   Replacement policy (default: every policy).\n");
+    printf("  -o <file>     Also write the results to <file> as a baseline.\n");
+    printf("  -c <file>     Compare against a baseline and exit with status 2\n");
+    printf("                if any combination is slower than it allows.\n");
+    printf("  -x <frac>     Slowdown allowed by -c (default 0.2).\n");
+    printf("Example: %s -w zipf:footprint=64M -g 6:8:6 -o base.txt\n", argv[0]);
+}
+
+/*
+ * parse_count - A number with an optional K, M or G suffix (powers of
+ *     1024), 0 if it is malformed
+ */
+static unsigned long long parse_count(const char* arg) {
+    char* end;
+    unsigned long long v = strtoull(arg, &end, 0);
+    if(*end == 'K' || *end == 'M' || *end == 'G') {
+        v <<= *end == 'K' ? 10 : *end == 'M' ? 20 : 30;
+        ++end;
+    }
+    return *end ? 0 : v;
+}
+
+/*
+ * read_baseline - Load the lines of a results file. Returns the number
+ *     read, or -1 if the file cannot be opened.
+ */
+static int read_baseline(const char* path, Result* base, int max) {
+    FILE* fp = fopen(path, "r");
+    char line[512];
+    int n = 0;
+    if(!fp)
+        return -1;
+    while(n < max && fgets(line, sizeof(line), fp)) {
+        if(line[0] == '#')
+            continue;
+        if(sscanf(line, "%127s %31s %31s %lf", base[n].workload, base[n].geometry,
+                   base[n].policy, &base[n].rate) == 4)
+            ++n;
+    }
+    fclose(fp);
+    return n;
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    const char* workloads[MAX_ITEMS];
+    const char* geometries[MAX_ITEMS];
+    const Policy* policy_list[MAX_ITEMS];
+    int nworkloads = 0, ngeometries = 0, npolicies = 0;
+    unsigned long long n = 1 << 21;
+    int runs = 3;
+    char* out = NULL;
+    char* compare = NULL;
+    double tolerance = 0.2;
+
+    while((opt = getopt(argc, argv, "n:r:w:g:p:o:c:x:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = parse_count(optarg);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'w':
+                if(nworkloads < MAX_ITEMS)
+                    workloads[nworkloads++] = optarg;
+                break;
+            case 'g':
+                if(ngeometries < MAX_ITEMS)
+                    geometries[ngeometries++] = optarg;
+                break;
+            case 'p':
+                if(npolicies < MAX_ITEMS && !(policy_list[npolicies++] = find_policy(optarg))) {
+                    usage(argv);
+                    exit(1);
+                }
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 'c':
+                compare = optarg;
+                break;
+            case 'x':
+                tolerance = atof(optarg);
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+    if(n == 0 || runs < 1 || tolerance < 0 || tolerance >= 1) {
+        usage(argv);
+        exit(1);
+    }
+    if(!nworkloads)
+        for(size_t i = 0; i < sizeof(default_workloads) / sizeof(*default_workloads); ++i)
+            workloads[nworkloads++] = default_workloads[i];
+    if(!ngeometries)
+        for(size_t i = 0; i < sizeof(default_geometries) / sizeof(*default_geometries); ++i)
+            geometries[ngeometries++] = default_geometries[i];
+    if(!npolicies)
+        for(int i = 0; policies[i] && npolicies < MAX_ITEMS; ++i)
+            policy_list[npolicies++] = policies[i];
+
+    static Result base[MAX_BASELINE];
+    int nbase = 0;
+    if(compare && (nbase = read_baseline(compare, base, MAX_BASELINE)) < 0) {
+        fprintf(stderr, "Error: Unable to read baseline %s\n", compare);
+        exit(1);
+    }
+    FILE* fp = NULL;
+    if(out && !(fp = fopen(out, "w"))) {
+        fprintf(stderr, "Error: Unable to create %s\n", out);
+        exit(1);
+    }
+
+    unsigned long long* addrs = malloc(n * sizeof(*addrs));
+    char* ops = malloc(n);
+    int* sizes = malloc(n * sizeof(*sizes));
+    if(!addrs || !ops || !sizes) {
+        fprintf(stderr, "Error: Unable to hold %llu accesses\n", n);
+        exit(1);
+    }
+
+    const char* header = "# workload geometry policy accesses/sec miss-rate\n";
+    printf("%s", header);
+    if(fp)
+        fprintf(fp, "%s", header);
+    int regressions = 0;
+    for(int w = 0; w < nworkloads; ++w) {
+        WorkloadConfig wcfg;
+        Workload* gen;
+        TraceRecord rec;
+        if(parse_workload(workloads[w], &wcfg) < 0 || !(wcfg.n = n, gen = workload_create(&wcfg))) {
+            fprintf(stderr, "Error: Malformed workload %s\n", workloads[w]);
+            exit(1);
+        }
+        for(unsigned long long i = 0; workload_next(gen, &rec); ++i) {
+            addrs[i] = rec.address;
+            ops[i] = rec.op;
+            sizes[i] = rec.size;
+        }
+        workload_free(gen);
+
+        for(int g = 0; g < ngeometries; ++g) {
+            SimConfig cfg = {0};
+            if(sscanf(geometries[g], "%d:%d:%d", &cfg.s, &cfg.E, &cfg.b) != 3) {
+                fprintf(stderr, "Error: Malformed geometry %s\n", geometries[g]);
+                exit(1);
+            }
+            for(int p = 0; p < npolicies; ++p) {
+                double best = 0;
+                SimStats stats;
+                cfg.policy = policy_list[p];
+                for(int r = 0; r < runs; ++r) {
+                    struct timespec start, end;
+                    Simulator* sim = sim_create(&cfg);
+                    if(!sim)
+                        exit(1);
+                    clock_gettime(CLOCK_MONOTONIC, &start);
+                    sim_access_batch(sim, addrs, ops, sizes, n);
+                    clock_gettime(CLOCK_MONOTONIC, &end);
+                    double sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+                    if(r == 0 || sec < best)
+                        best = sec;
+                    sim_stats(sim, &stats);
+                    sim_free(sim);
+                }
+                double rate = best > 0 ? n / best : 0.0;
+                SimLevelStats* st = &stats.level[0];
+                double miss_rate = st->hits + st->misses ? (double)st->misses / (st->hits + st->misses) : 0.0;
+                printf("%s %s %s %.0f %.4f", workloads[w], geometries[g], cfg.policy->name, rate, miss_rate);
+                if(fp)
+                    fprintf(fp, "%s %s %s %.0f %.4f\n", workloads[w], geometries[g], cfg.policy->name, rate, miss_rate);
+                for(int k = 0; k < nbase; ++k) {
+                    if(strcmp(base[k].workload, workloads[w]) != 0 || strcmp(base[k].geometry, geometries[g]) != 0 ||
+                        strcmp(base[k].policy, cfg.policy->name) != 0)
+                        continue;
+                    printf(" baseline:%.0f (%+.1f%%)", base[k].rate, base[k].rate > 0 ? 100 * (rate / base[k].rate - 1) : 0.0);
+                    if(rate < base[k].rate * (1 - tolerance)) {
+                        printf(" REGRESSION");
+                        ++regressions;
+                    }
+                    break;
+                }
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+    free(addrs);
+    free(ops);
+    free(sizes);
+    if(fp && fclose(fp) != 0) {
+        fprintf(stderr, "Error: Failed writing %s\n", out);
+        exit(1);
+    }
+    if(regressions) {
+        fprintf(stderr, "%d combinations slower than the baseline allows\n", regressions);
+        return 2;
+    }
+    return 0;
+}
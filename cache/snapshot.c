@@ -0,0 +1,70 @@
+/*
+ * snapshot.c - Binary encoding helpers for simulator checkpoints
+ *
+ * snap_put_words writes an array as chunks of a varint count of zero
+ * words, a varint count of literal words and those words, until the
+ * array is covered.
+ */
+#include "snapshot.h"
+
+int snap_put(FILE* fp, const void* p, size_t bytes) {
+    return fwrite(p, 1, bytes, fp) == bytes ? 0 : -1;
+}
+
+int snap_get(FILE* fp, void* p, size_t bytes) {
+    return fread(p, 1, bytes, fp) == bytes ? 0 : -1;
+}
+
+static int put_varint(FILE* fp, unsigned long long v) {
+    while(v >= 0x80) {
+        if(putc((int)(v & 0x7f) | 0x80, fp) == EOF)
+            return -1;
+        v >>= 7;
+    }
+    return putc((int)v, fp) == EOF ? -1 : 0;
+}
+
+static int get_varint(FILE* fp, unsigned long long* v) {
+    *v = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        int c = getc(fp);
+        if(c == EOF)
+            return -1;
+        *v |= (unsigned long long)(c & 0x7f) << shift;
+        if(!(c & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+int snap_put_words(FILE* fp, const unsigned long long* p, size_t n) {
+    size_t i = 0;
+    while(i < n) {
+        size_t zeros = 0, literals = 0;
+        while(i + zeros < n && !p[i + zeros])
+            ++zeros;
+        while(i + zeros + literals < n && p[i + zeros + literals])
+            ++literals;
+        if(put_varint(fp, zeros) < 0 || put_varint(fp, literals) < 0 ||
+           snap_put(fp, p + i + zeros, literals * sizeof(*p)) < 0)
+            return -1;
+        i += zeros + literals;
+    }
+    return 0;
+}
+
+int snap_get_words(FILE* fp, unsigned long long* p, size_t n) {
+    size_t i = 0;
+    while(i < n) {
+        unsigned long long zeros, literals;
+        if(get_varint(fp, &zeros) < 0 || get_varint(fp, &literals) < 0 ||
+           zeros > n - i || literals > n - i - zeros)
+            return -1;
+        for(; zeros; --zeros)
+            p[i++] = 0;
+        if(snap_get(fp, p + i, literals * sizeof(*p)) < 0)
+            return -1;
+        i += literals;
+    }
+    return 0;
+}
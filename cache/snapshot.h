@@ -0,0 +1,32 @@
+/*
+ * snapshot.h - Binary encoding helpers for simulator checkpoints
+ */
+
+#ifndef CACHELAB_SNAPSHOT_H
+#define CACHELAB_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Every function returns 0 on success and -1 on a write error, or on a
+ * short or malformed read. Values are stored in host byte order:
+ * checkpoints are only read back by the build that wrote them.
+ */
+
+/* snap_put - Write bytes as they are */
+int snap_put(FILE* fp, const void* p, size_t bytes);
+
+/* snap_get - Read bytes written by snap_put */
+int snap_get(FILE* fp, void* p, size_t bytes);
+
+/*
+ * snap_put_words - Write n words, leaving runs of zero words out, so
+ *     the mostly empty arrays of a cold cache stay small
+ */
+int snap_put_words(FILE* fp, const unsigned long long* p, size_t n);
+
+/* snap_get_words - Read n words written by snap_put_words */
+int snap_get_words(FILE* fp, unsigned long long* p, size_t n);
+
+#endif /* CACHELAB_SNAPSHOT_H */
@@ -0,0 +1,229 @@
+/*
+ * sweep.c - Single-pass simulation of many LRU cache geometries
+ *
+ * Under LRU an access hits in an E-way set exactly when fewer than E
+ * other blocks of that set were touched since the block's last use, its
+ * stack distance (Mattson et al., 1970). So for each block size and each
+ * set index width we keep one recency stack per set and histogram the
+ * depth at which every access finds its block; the hits of every
+ * associativity are then prefix sums of that histogram. Stacks are cut
+ * off at the largest E requested since deeper blocks miss everywhere.
+ *
+ * Evictions follow from the misses: lines are never invalidated, so a
+ * set only fills empty lines on its first min(E, distinct blocks) misses
+ * and every other miss evicts.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "sweep.h"
+
+/* Per (b, s) pair: the recency stacks of every set */
+typedef struct {
+    int s;
+    unsigned long long* stack;    //S * depth_max blocks, MRU first
+    unsigned int* depth;          //valid entries of each stack
+    unsigned long long* distinct; //blocks ever mapped to each set
+    unsigned long long* hist;     //hits found at each stack depth
+} SweepLevel;
+
+/* Per block size: the blocks seen so far and one level per s */
+typedef struct {
+    int b;
+    unsigned long long* seen;    //open addressing set of blocks + 1
+    size_t seen_cap, seen_count;
+    int seen_max;                //block ~0ULL has no +1 encoding
+    unsigned long long accesses; //block touches, after splitting
+    SweepLevel* levels;
+} SweepBlock;
+
+struct sweep {
+    int ns, nE, nb;
+    int s_vals[SWEEP_MAX_VALUES], E_vals[SWEEP_MAX_VALUES];
+    unsigned int depth_max;
+    SweepBlock* blocks;
+};
+
+static size_t hash_block(unsigned long long blk) {
+    blk ^= blk >> 33;
+    blk *= 0xff51afd7ed558ccdULL;
+    blk ^= blk >> 33;
+    return blk;
+}
+
+/*
+ * seen_insert - Add blk to the seen set. Returns 1 if it was not there.
+ */
+static int seen_insert(SweepBlock* sb, unsigned long long blk) {
+    if(blk == ~0ULL) {
+        int first = !sb->seen_max;
+        sb->seen_max = 1;
+        return first;
+    }
+    if(2 * (sb->seen_count + 1) > sb->seen_cap) { //keep load under 1/2
+        size_t cap = sb->seen_cap ? 2 * sb->seen_cap : 1024;
+        unsigned long long* seen = calloc(cap, sizeof(*seen));
+        if(!seen)
+            abort();
+        for(size_t i = 0; i < sb->seen_cap; ++i) {
+            if(!sb->seen[i])
+                continue;
+            size_t j = hash_block(sb->seen[i] - 1) & (cap - 1);
+            while(seen[j])
+                j = (j + 1) & (cap - 1);
+            seen[j] = sb->seen[i];
+        }
+        free(sb->seen);
+        sb->seen = seen;
+        sb->seen_cap = cap;
+    }
+    size_t j = hash_block(blk) & (sb->seen_cap - 1);
+    while(sb->seen[j]) {
+        if(sb->seen[j] == blk + 1)
+            return 0;
+        j = (j + 1) & (sb->seen_cap - 1);
+    }
+    sb->seen[j] = blk + 1;
+    ++sb->seen_count;
+    return 1;
+}
+
+Sweep* sweep_create(const int* s_vals, int ns, const int* E_vals, int nE,
+                    const int* b_vals, int nb) {
+    if(ns > SWEEP_MAX_VALUES || nE > SWEEP_MAX_VALUES || nb > SWEEP_MAX_VALUES)
+        return NULL;
+    Sweep* sw = calloc(1, sizeof(Sweep));
+    if(!sw)
+        return NULL;
+    sw->ns = ns;
+    sw->nE = nE;
+    sw->nb = nb;
+    memcpy(sw->s_vals, s_vals, ns * sizeof(int));
+    memcpy(sw->E_vals, E_vals, nE * sizeof(int));
+    for(int i = 0; i < nE; ++i)
+        if((unsigned int)E_vals[i] > sw->depth_max)
+            sw->depth_max = E_vals[i];
+
+    sw->blocks = calloc(nb, sizeof(SweepBlock));
+    if(!sw->blocks)
+        goto fail;
+    for(int i = 0; i < nb; ++i) {
+        SweepBlock* sb = &sw->blocks[i];
+        sb->b = b_vals[i];
+        sb->levels = calloc(ns, sizeof(SweepLevel));
+        if(!sb->levels)
+            goto fail;
+        for(int j = 0; j < ns; ++j) {
+            SweepLevel* lv = &sb->levels[j];
+            size_t S = (size_t)1 << s_vals[j];
+            lv->s = s_vals[j];
+            lv->stack = malloc(S * sw->depth_max * sizeof(*lv->stack));
+            lv->depth = calloc(S, sizeof(*lv->depth));
+            lv->distinct = calloc(S, sizeof(*lv->distinct));
+            lv->hist = calloc(sw->depth_max, sizeof(*lv->hist));
+            if(!lv->stack || !lv->depth || !lv->distinct || !lv->hist)
+                goto fail;
+        }
+    }
+    return sw;
+
+fail:
+    sweep_free(sw);
+    return NULL;
+}
+
+/*
+ * touch_block - Move blk to the top of its stack for every set index width
+ */
+static void touch_block(const Sweep* sw, SweepBlock* sb, unsigned long long blk) {
+    unsigned int depth_max = sw->depth_max;
+    int first = seen_insert(sb, blk);
+    ++sb->accesses;
+    for(int j = 0; j < sw->ns; ++j) {
+        SweepLevel* lv = &sb->levels[j];
+        unsigned long long set = blk & ((1ULL << lv->s) - 1);
+        unsigned long long* stack = lv->stack + set * depth_max;
+        unsigned int d = lv->depth[set], k = 0;
+
+        if(!first) {
+            for(k = 0; k < d; ++k)
+                if(stack[k] == blk)
+                    break;
+        }
+        else {
+            k = d;
+            ++lv->distinct[set];
+        }
+        if(k < d) { //found at depth k
+            ++lv->hist[k];
+        }
+        else if(d < depth_max) {
+            lv->depth[set] = ++d;
+        }
+        else {
+            k = d - 1; //drop the deepest block
+        }
+        memmove(stack + 1, stack, k * sizeof(*stack));
+        stack[0] = blk;
+    }
+}
+
+/*
+ * block_of - Block number of address; with b >= 64 all of memory is one block
+ */
+static unsigned long long block_of(const SweepBlock* sb, unsigned long long address) {
+    return sb->b >= 64 ? 0 : address >> sb->b;
+}
+
+void sweep_access(Sweep* sw, unsigned long long address, int size) {
+    unsigned long long last = size > 1 ? address + (size - 1) : address;
+    if(last < address) //wrapped past the top of memory
+        last = ~0ULL;
+    for(int i = 0; i < sw->nb; ++i) {
+        SweepBlock* sb = &sw->blocks[i];
+        unsigned long long end = block_of(sb, last);
+        for(unsigned long long blk = block_of(sb, address); ; ++blk) {
+            touch_block(sw, sb, blk);
+            if(blk == end)
+                break;
+        }
+    }
+}
+
+void sweep_report(const Sweep* sw, FILE* fp) {
+    for(int i = 0; i < sw->nb; ++i) {
+        const SweepBlock* sb = &sw->blocks[i];
+        for(int j = 0; j < sw->ns; ++j) {
+            const SweepLevel* lv = &sb->levels[j];
+            size_t S = (size_t)1 << lv->s;
+            for(int e = 0; e < sw->nE; ++e) {
+                unsigned long long E = sw->E_vals[e];
+                unsigned long long hits = 0, fills = 0;
+                for(unsigned int d = 0; d < E; ++d)
+                    hits += lv->hist[d];
+                for(size_t set = 0; set < S; ++set)
+                    fills += lv->distinct[set] < E ? lv->distinct[set] : E;
+                unsigned long long misses = sb->accesses - hits;
+                fprintf(fp, "s:%d E:%llu b:%d hits:%llu misses:%llu evictions:%llu\n",
+                        lv->s, E, sb->b, hits, misses, misses - fills);
+            }
+        }
+    }
+}
+
+void sweep_free(Sweep* sw) {
+    if(!sw)
+        return;
+    for(int i = 0; sw->blocks && i < sw->nb; ++i) {
+        SweepBlock* sb = &sw->blocks[i];
+        for(int j = 0; sb->levels && j < sw->ns; ++j) {
+            free(sb->levels[j].stack);
+            free(sb->levels[j].depth);
+            free(sb->levels[j].distinct);
+            free(sb->levels[j].hist);
+        }
+        free(sb->levels);
+        free(sb->seen);
+    }
+    free(sw->blocks);
+    free(sw);
+}
@@ -0,0 +1,37 @@
+/*
+ * sweep.h - Single-pass simulation of many LRU cache geometries
+ */
+
+#ifndef CACHELAB_SWEEP_H
+#define CACHELAB_SWEEP_H
+
+#include <stdio.h>
+
+#define SWEEP_MAX_VALUES 64
+
+typedef struct sweep Sweep;
+
+/*
+ * sweep_create - Prepare to simulate every combination of the given set
+ *     index widths, associativities and block offset widths. Returns
+ *     NULL if the per-set stacks cannot be allocated.
+ */
+Sweep* sweep_create(const int* s_vals, int ns, const int* E_vals, int nE,
+                    const int* b_vals, int nb);
+
+/*
+ * sweep_access - Feed one cache access of size bytes to every
+ *     configuration, touching each block it covers (size <= 1 touches one)
+ */
+void sweep_access(Sweep* sw, unsigned long long address, int size);
+
+/*
+ * sweep_report - Print one "s:.. E:.. b:.. hits:.. misses:.. evictions:.."
+ *     line per configuration, in the same counter format as printSummary
+ */
+void sweep_report(const Sweep* sw, FILE* fp);
+
+/* sweep_free - Release the sweep */
+void sweep_free(Sweep* sw);
+
+#endif /* CACHELAB_SWEEP_H */
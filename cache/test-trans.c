@@ -3,6 +3,7 @@
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
  */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,14 +11,23 @@
 #include <string.h>
 #include <signal.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "trace.h"
+#include "sim.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
 
 /* Maximum array dimension */
 #define MAXN 256
 
+/* Accesses handed to the simulator per call */
+#define ACCESS_BATCH 4096
+
+/* Most functions evaluated at once */
+#define MAX_WORKERS 64
+
 /* The description string for the transpose_submit() function that the
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
@@ -32,6 +42,30 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static VictimConfig victim_cfg;
+static int use_victim = 0; /* -V: a victim or miss cache behind the cache */
+
+/* Where the traces come from */
+enum { TRACE_VALGRIND, TRACE_NATIVE, TRACE_CROSSCHECK };
+static int trace_source = TRACE_VALGRIND;
+static int crosscheck_mismatches = 0;
+static int nworkers = 0; /* -j: functions evaluated at once, 0 for one per CPU */
+
+/* What evaluating one function found */
+struct evaluation {
+    int status;       /* tracegen's exit status */
+    SimStats stats;
+    int check_status; /* with -x, the native tracegen's */
+    SimStats check;
+};
+
+/* The functions still to evaluate, handed out to the workers in order */
+static struct {
+    pthread_mutex_t lock;
+    int next;
+    const SimConfig* cfg;
+    struct evaluation* evals;
+} pool = {PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL};
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -41,46 +75,212 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/*
+ * read_markers - Read the marker addresses tracegen records in path.
+ *     Returns 0 if the file is not there or not complete yet.
+ */
+static int read_markers(const char* path, unsigned long long* start, unsigned long long* end)
+{
+    FILE* marker_fp = fopen(path, "r");
+    if (!marker_fp)
+        return 0;
+    int n = fscanf(marker_fp, "%llx %llx", start, end);
+    fclose(marker_fp);
+    return n == 2;
+}
+
+/*
+ * simulate_trace - Simulate the accesses one transpose function makes,
+ *     produced by tracegen under valgrind, or by tracegen itself if
+ *     native is set. tracegen records its markers in marker_path, which
+ *     belongs to the calling worker. Returns tracegen's exit status.
+ *
+ * valgrind's output is read from a pipe and the accesses between the
+ * markers are simulated as they arrive, so no trace is ever written to
+ * disk. tracegen records the marker addresses in .marker before it
+ * stores to either marker, so the file is complete by the time the first
+ * one-byte store that could be the start marker comes down the pipe.
+ * A native trace holds only the function's accesses and the two marker
+ * stores around them, so all of it is simulated.
+ */
+static int simulate_trace(int func, int native, const char* marker_path,
+                          const SimConfig* cfg, SimStats* stats)
+{
+    int flag;
+    int have_markers;
+    unsigned long long int marker_start = 0, marker_end = 0, addr;
+    char cmd[255];
+    TraceRecord rec;
+    unsigned long long addrs[ACCESS_BATCH];
+    char ops[ACCESS_BATCH];
+    int sizes[ACCESS_BATCH];
+    size_t n;
+
+    if (native) {
+        sprintf(cmd, "./tracegen -M %d -N %d -F %d -m %s -t -", M, N, func, marker_path);
+    }
+    else {
+        /* Use valgrind to generate the trace, and read it as it is produced */
+        unlink(marker_path); /* never pick up the markers of an earlier run */
+        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d -m %s",
+                M, N, func, marker_path);
+    }
+    FILE* pipe_fp = popen(cmd, "r");
+    assert(pipe_fp);
+    TraceReader* trace = trace_fdopen(fileno(pipe_fp), TRACE_STREAM);
+    assert(trace);
+
+    Simulator* sim = sim_create(cfg);
+    assert(sim);
+
+    /* Simulate the accesses of the trans function, then drain the rest */
+    flag = native;
+    have_markers = native;
+    n = 0;
+    while (trace_next(trace, &rec)) {
+        addr = rec.address;
+
+        /* The markers are one-byte stores; only look for them then */
+        if (!have_markers) {
+            if (rec.size != 1 || !read_markers(marker_path, &marker_start, &marker_end))
+                continue;
+            have_markers = 1;
+        }
+
+        /* If start marker found, set flag */
+        if (addr == marker_start && flag == 0)
+            flag = 1;
+
+        /* Valgrind creates many spurious accesses to the
+           stack that have nothing to do with the students
+           code. At the moment, we are ignoring all stack
+           accesses by using the simple filter of recording
+           accesses to only the low 32-bit portion of the
+           address space. At some point it would be nice to
+           try to do more informed filtering so that would
+           eliminate the valgrind stack references while
+           include the student stack references. */
+        if (flag == 1 && (native || addr < 0xffffffff)) {
+            addrs[n] = addr;
+            ops[n] = rec.op;
+            sizes[n++] = rec.size;
+            if (n == ACCESS_BATCH) {
+                sim_access_batch(sim, addrs, ops, sizes, n);
+                n = 0;
+            }
+        }
+
+        /* if end marker found, stop simulating */
+        if (addr == marker_end && flag == 1 && !native)
+            flag = 2;
+    }
+    sim_access_batch(sim, addrs, ops, sizes, n);
+    sim_stats(sim, stats);
+    sim_free(sim);
+    trace_close(trace);
+    return WEXITSTATUS(pclose(pipe_fp));
+}
+
+/*
+ * eval_worker - Evaluate functions until none are left, with tracegen
+ *     writing its markers to a file of this worker's own
+ */
+static void* eval_worker(void* arg)
+{
+    char marker_path[32];
+    sprintf(marker_path, ".marker.%d", (int)(long)arg);
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        int i = pool.next++;
+        pthread_mutex_unlock(&pool.lock);
+        if (i >= func_counter)
+            break;
+
+        struct evaluation* e = &pool.evals[i];
+        e->status = simulate_trace(i, trace_source == TRACE_NATIVE, marker_path, pool.cfg, &e->stats);
+        if (e->status == 0 && trace_source == TRACE_CROSSCHECK) /* capture natively as well */
+            e->check_status = simulate_trace(i, 1, marker_path, pool.cfg, &e->check);
+    }
+    unlink(marker_path);
+    return NULL;
+}
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
+ *
+ * The functions are traced and simulated on a pool of workers, each
+ * with its own tracegen, marker file and simulator, and the results
+ * are reported in function order once all of them are in.
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
     int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    SimConfig cfg = {0};
+    static struct evaluation evals[MAX_TRANS_FUNCS];
+    pthread_t workers[MAX_WORKERS];
 
-    registerFunctions(); 
+    cfg.s = s;
+    cfg.E = E;
+    cfg.b = b;
+    if (use_victim)
+        cfg.victim = &victim_cfg;
 
-    /* Open the complete trace file */
-    FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
+    registerFunctions(); 
 
     /* Evaluate the performance of each registered transpose function */
+    pool.cfg = &cfg;
+    pool.evals = evals;
+    int n = nworkers > 0 ? nworkers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > func_counter)
+        n = func_counter;
+    if (n > MAX_WORKERS)
+        n = MAX_WORKERS;
+    if (n < 1)
+        n = 1;
+    for (i = 0; i < n; i++) {
+        if (pthread_create(&workers[i], NULL, eval_worker, (void*)(long)i) != 0) {
+            fprintf(stderr, "Unable to start worker %d\n", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < n; i++)
+        pthread_join(workers[i], NULL);
 
     for (i=0; i<func_counter; i++) {
+        struct evaluation* e = &evals[i];
         if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
             results.funcid = i; /* remember which function is the submission */
 
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+        printf("\nFunction %d (%d total)\nStep 1: Validating and simulating memory traces (s=%d, E=%d, b=%d)\n",
+               i, func_counter, s, E, b);
 
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
+        flag = e->status;
         if (0!=flag) {
             printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
             continue;
         }
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
+        /* Compare the native capture with valgrind's */
+        if (trace_source == TRACE_CROSSCHECK) {
+            if (e->check_status != 0) {
+                printf("func %u (%s): cross-check failed, native capture did not run\n",
+                       i, func_list[i].description);
+                ++crosscheck_mismatches;
+            }
+            else if (e->check.level[0].hits != e->stats.level[0].hits ||
+                     e->check.level[0].misses != e->stats.level[0].misses ||
+                     e->check.level[0].evictions != e->stats.level[0].evictions) {
+                printf("func %u (%s): cross-check MISMATCH, native hits:%llu, misses:%llu, evictions:%llu\n",
+                       i, func_list[i].description, e->check.level[0].hits,
+                       e->check.level[0].misses, e->check.level[0].evictions);
+                ++crosscheck_mismatches;
+            }
+            else {
+                printf("func %u (%s): cross-check ok, native capture matches valgrind\n",
+                       i, func_list[i].description);
+            }
+        }
 
         func_list[i].correct=1;
 
@@ -89,72 +289,20 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.correct = 1;
         }
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
-            }
-        }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
-        func_list[i].num_hits = hits;
-        func_list[i].num_misses = misses;
-        func_list[i].num_evictions = evictions;
+        func_list[i].num_hits = e->stats.level[0].hits;
+        func_list[i].num_misses = e->stats.level[0].misses;
+        func_list[i].num_evictions = e->stats.level[0].evictions;
         printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
-               i, func_list[i].description, hits, misses, evictions);
+               i, func_list[i].description, func_list[i].num_hits,
+               func_list[i].num_misses, func_list[i].num_evictions);
+        if (use_victim)
+            printf("func %u (%s): %s-cache hits:%llu, misses:%llu\n",
+                   i, func_list[i].description, victim_name(victim_cfg.kind),
+                   e->stats.level[0].victim_hits, e->stats.level[0].victim_misses);
     
         /* If it is transpose_submit(), record number of misses */
         if (results.funcid == i) {
-            results.misses = misses;
+            results.misses = func_list[i].num_misses;
         }
     }
   
@@ -164,11 +312,18 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hnx] [-j <num>] [-V <buffer>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+    printf("  -j <num>    Evaluate <num> functions at once (default: one per CPU)\n");
+    printf("  -n          Capture the traces natively in tracegen instead of\n");
+    printf("              running it under valgrind\n");
+    printf("  -x          Capture both ways and report any function whose\n");
+    printf("              counts differ (valgrind's are graded)\n");
+    printf("  -V <buf>    Also count the misses a victim:N or miss:N cache of\n");
+    printf("              N lines would serve (misses are still graded as is)\n");
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
 }
 
@@ -199,7 +354,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:V:j:nxh")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +362,23 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'j':
+            nworkers = atoi(optarg);
+            break;
+        case 'n':
+            trace_source = TRACE_NATIVE;
+            break;
+        case 'x':
+            trace_source = TRACE_CROSSCHECK;
+            break;
+        case 'V':
+            if (parse_victim(optarg, &victim_cfg) < 0) {
+                printf("Error: Bad victim or miss cache %s\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            use_victim = 1;
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -257,5 +429,10 @@ int main(int argc, char* argv[])
                results.funcid, results.correct, results.misses);
         printf("\nTEST_TRANS_RESULTS=%d:%d\n", results.correct, results.misses);
     }
+    if (crosscheck_mismatches) {
+        printf("\nError: %d functions traced differently natively and under valgrind\n",
+               crosscheck_mismatches);
+        return 2;
+    }
     return 0;
 }
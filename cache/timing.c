@@ -0,0 +1,249 @@
+/*
+ * timing.c - Cycle-approximate timing of the accesses the cache model serves
+ *
+ * The cache model decides where every access is served; this adds when.
+ * Accesses issue in program order, width per cycle, but at most window
+ * of them may be in flight: an access cannot issue before the one window
+ * places ahead of it has retired, and accesses retire in order. A load
+ * retires when its data arrives, a store as soon as it is in the store
+ * buffer, an L1 hit latency after issue.
+ *
+ * A miss in L1 holds an MSHR until its data arrives. A later access to
+ * the same L1 block waits for that data instead of being served again,
+ * even though the cache model already counts it as a hit. While every
+ * MSHR is taken, a miss cannot issue, nor anything after it. The data
+ * arrives after the latency of the level that served it. For DRAM, the
+ * request first goes through the last level and then queues for one
+ * channel that moves bandwidth bytes per cycle, then pays the DRAM
+ * latency. Writebacks and write-through stores take the channel
+ * too, but nothing waits for them.
+ *
+ * This is the structure of the simple out-of-order core models of
+ * Karkhanis and Smith (2004): memory-level parallelism comes from the
+ * window, and the MSHRs and the bus bound it. Queueing in the lower
+ * levels and DRAM banks is not modeled.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "timing.h"
+#include "snapshot.h"
+
+static const int default_latency[MAX_LEVELS] = {4, 14, 40, 60};
+
+#define MAX_MSHRS 1024
+#define MAX_WINDOW (1 << 20)
+#define MAX_WIDTH 64
+
+typedef struct {
+    unsigned long long block;
+    unsigned long long done; //cycle the data arrives; free after it
+} Mshr;
+
+struct timing {
+    TimingConfig cfg;
+    int levels, b;
+    Mshr* mshr;
+    unsigned long long* retired;     //retirement cycle of the last window accesses
+    unsigned long long head;         //accesses issued, and so the next ring slot
+    unsigned long long issue_cycle;  //cycle of the latest issue
+    int issued;                      //accesses issued in it
+    unsigned long long last_retire;
+    unsigned long long dram_free;    //cycle the DRAM channel is next idle
+    unsigned long long start;        //cycle the counts start from
+    TimingStats stats;
+};
+
+int parse_timing(const char* arg, TimingConfig* cfg) {
+    memcpy(cfg->latency, default_latency, sizeof(default_latency));
+    cfg->memory_latency = 200;
+    cfg->bandwidth = 16;
+    cfg->mshrs = 10;
+    cfg->window = 64;
+    cfg->width = 2;
+    if(!*arg || strcmp(arg, "default") == 0)
+        return 0;
+
+    for(const char* p = arg; ; ++p) {
+        const char* eq = strchr(p, '=');
+        char* end;
+        if(!eq)
+            return -1;
+        size_t len = eq - p;
+        long v = strtol(eq + 1, &end, 10);
+        if(end == eq + 1)
+            return -1;
+        if(len == 3 && strncmp(p, "lat", 3) == 0) {
+            for(int i = 0; ; ++i) {
+                if(i == MAX_LEVELS || v < 0)
+                    return -1;
+                cfg->latency[i] = v;
+                if(*end != '/')
+                    break;
+                const char* q = end + 1;
+                v = strtol(q, &end, 10);
+                if(end == q)
+                    return -1;
+            }
+        }
+        else if(len == 3 && strncmp(p, "mem", 3) == 0 && v >= 0)
+            cfg->memory_latency = v;
+        else if(len == 2 && strncmp(p, "bw", 2) == 0 && v > 0)
+            cfg->bandwidth = v;
+        else if(len == 5 && strncmp(p, "mshrs", 5) == 0 && v > 0 && v <= MAX_MSHRS)
+            cfg->mshrs = v;
+        else if(len == 6 && strncmp(p, "window", 6) == 0 && v > 0 && v <= MAX_WINDOW)
+            cfg->window = v;
+        else if(len == 5 && strncmp(p, "width", 5) == 0 && v > 0 && v <= MAX_WIDTH)
+            cfg->width = v;
+        else
+            return -1;
+        if(!*end)
+            return 0;
+        if(*end != ',')
+            return -1;
+        p = end;
+    }
+}
+
+void format_timing(const TimingConfig* cfg, int levels, char sep, char* buf, size_t size) {
+    size_t len = snprintf(buf, size, "lat=");
+    for(int i = 0; i < levels && len < size; ++i)
+        len += snprintf(buf + len, size - len, "%s%d", i ? "/" : "", cfg->latency[i]);
+    if(len < size)
+        snprintf(buf + len, size - len, "%cmem=%d%cbw=%d%cmshrs=%d%cwindow=%d%cwidth=%d", sep, cfg->memory_latency,
+                 sep, cfg->bandwidth, sep, cfg->mshrs, sep, cfg->window, sep, cfg->width);
+}
+
+Timing* timing_create(const TimingConfig* cfg, int levels, int b) {
+    Timing* t = calloc(1, sizeof(Timing));
+    if(!t)
+        return NULL;
+    t->cfg = *cfg;
+    t->levels = levels;
+    t->b = b;
+    t->mshr = calloc(cfg->mshrs, sizeof(Mshr));
+    t->retired = calloc(cfg->window, sizeof(unsigned long long));
+    if(!t->mshr || !t->retired) {
+        timing_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+/* transfer - Cycles the DRAM channel needs for bytes */
+static unsigned long long transfer(const Timing* t, unsigned long long bytes) {
+    return (bytes + t->cfg.bandwidth - 1) / t->cfg.bandwidth;
+}
+
+void timing_access(Timing* t, unsigned long long address, int write, int level,
+                   unsigned long long memory_read, unsigned long long memory_written) {
+    const TimingConfig* cfg = &t->cfg;
+    unsigned long long block = address >> t->b;
+    unsigned long long* slot = &t->retired[t->head % cfg->window];
+
+    //issue, once the window and, for a miss, an MSHR allow it
+    unsigned long long issue = t->issued < cfg->width ? t->issue_cycle : t->issue_cycle + 1;
+    if(*slot > issue) {
+        t->stats.window_stalls += *slot - issue;
+        issue = *slot;
+    }
+    Mshr* pending = NULL;
+    Mshr* first_free = &t->mshr[0];
+    for(int i = 0; i < cfg->mshrs; ++i) {
+        if(t->mshr[i].done > issue && t->mshr[i].block == block)
+            pending = &t->mshr[i];
+        if(t->mshr[i].done < first_free->done)
+            first_free = &t->mshr[i];
+    }
+    if(level == TIMING_AROUND)
+        pending = NULL;
+    if(level > 0 && !pending && first_free->done > issue) {
+        t->stats.mshr_stalls += first_free->done - issue;
+        issue = first_free->done;
+    }
+    if(issue != t->issue_cycle) {
+        t->issue_cycle = issue;
+        t->issued = 0;
+    }
+    ++t->issued;
+
+    //data
+    unsigned long long complete;
+    if(pending) {
+        complete = pending->done;
+        ++t->stats.mshr_merges;
+    }
+    else if(level <= 0) {
+        complete = issue + cfg->latency[0];
+    }
+    else {
+        if(level < t->levels) {
+            complete = issue + cfg->latency[level];
+        }
+        else { //through the last level, then DRAM once the channel is free
+            unsigned long long arrive = issue + cfg->latency[t->levels - 1];
+            unsigned long long busy = transfer(t, memory_read);
+            unsigned long long begin = arrive > t->dram_free ? arrive : t->dram_free;
+            t->dram_free = begin + busy;
+            t->stats.dram_busy += busy;
+            complete = begin + cfg->memory_latency + busy;
+        }
+        first_free->block = block;
+        first_free->done = complete;
+    }
+    if(memory_written) { //off the critical path, but it holds the channel
+        unsigned long long busy = transfer(t, memory_written);
+        t->dram_free = (t->dram_free > issue ? t->dram_free : issue) + busy;
+        t->stats.dram_busy += busy;
+    }
+    ++t->stats.accesses;
+    t->stats.latency += complete - issue;
+
+    //retire
+    unsigned long long retire = write ? issue + cfg->latency[0] : complete;
+    if(retire < t->last_retire)
+        retire = t->last_retire;
+    t->last_retire = retire;
+    *slot = retire;
+    ++t->head;
+}
+
+void timing_stats(const Timing* t, TimingStats* stats) {
+    *stats = t->stats;
+    stats->cycles = t->last_retire > t->start ? t->last_retire - t->start : 0;
+}
+
+void timing_clear(Timing* t) {
+    memset(&t->stats, 0, sizeof(t->stats));
+    t->start = t->issue_cycle;
+}
+
+int timing_save(const Timing* t, FILE* fp) {
+    if(snap_put(fp, t->mshr, t->cfg.mshrs * sizeof(Mshr)) < 0 ||
+       snap_put_words(fp, t->retired, t->cfg.window) < 0)
+        return -1;
+    if(snap_put(fp, &t->head, sizeof(t->head)) < 0 || snap_put(fp, &t->issue_cycle, sizeof(t->issue_cycle)) < 0 ||
+       snap_put(fp, &t->issued, sizeof(t->issued)) < 0 || snap_put(fp, &t->last_retire, sizeof(t->last_retire)) < 0 ||
+       snap_put(fp, &t->dram_free, sizeof(t->dram_free)) < 0 || snap_put(fp, &t->start, sizeof(t->start)) < 0)
+        return -1;
+    return snap_put(fp, &t->stats, sizeof(t->stats));
+}
+
+int timing_load(Timing* t, FILE* fp) {
+    if(snap_get(fp, t->mshr, t->cfg.mshrs * sizeof(Mshr)) < 0 ||
+       snap_get_words(fp, t->retired, t->cfg.window) < 0)
+        return -1;
+    if(snap_get(fp, &t->head, sizeof(t->head)) < 0 || snap_get(fp, &t->issue_cycle, sizeof(t->issue_cycle)) < 0 ||
+       snap_get(fp, &t->issued, sizeof(t->issued)) < 0 || snap_get(fp, &t->last_retire, sizeof(t->last_retire)) < 0 ||
+       snap_get(fp, &t->dram_free, sizeof(t->dram_free)) < 0 || snap_get(fp, &t->start, sizeof(t->start)) < 0)
+        return -1;
+    return snap_get(fp, &t->stats, sizeof(t->stats));
+}
+
+void timing_free(Timing* t) {
+    if(!t)
+        return;
+    free(t->mshr);
+    free(t->retired);
+    free(t);
+}
@@ -0,0 +1,85 @@
+/*
+ * timing.h - Cycle-approximate timing of the accesses the cache model serves
+ */
+
+#ifndef CACHELAB_TIMING_H
+#define CACHELAB_TIMING_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "hier.h"
+
+typedef struct {
+    int latency[MAX_LEVELS]; //cycles to the data when level i serves an access
+    int memory_latency;      //cycles DRAM adds below the last level
+    int bandwidth;           //DRAM bytes per cycle
+    int mshrs;               //misses L1 can have outstanding
+    int window;              //accesses in flight before issue stalls
+    int width;               //accesses issued per cycle
+} TimingConfig;
+
+typedef struct {
+    unsigned long long cycles;          //from the first issue to the last retirement
+    unsigned long long accesses;        //accesses timed
+    unsigned long long latency;         //their cycles from issue to data, summed
+    unsigned long long mshr_merges;     //accesses that waited on a miss to their block in flight
+    unsigned long long mshr_stalls;     //cycles issue waited for a free MSHR
+    unsigned long long window_stalls;   //cycles issue waited for the window
+    unsigned long long dram_busy;       //cycles DRAM spent transferring
+} TimingStats;
+
+typedef struct timing Timing;
+
+/* Where timing_access is told an access was served */
+#define TIMING_AROUND -1 //a store that missed a no-write-allocate L1
+
+/*
+ * parse_timing - Parse "key=value[,key=value]..." with the keys lat
+ *     (cycles per level, L1 first, separated by '/'), mem, bw, mshrs,
+ *     window and width. Unset keys keep their defaults, which an empty
+ *     string or "default" leaves all of. Returns -1 if it is malformed.
+ */
+int parse_timing(const char* arg, TimingConfig* cfg);
+
+/*
+ * format_timing - Write cfg as parse_timing accepts it, for levels cache
+ *     levels, with sep between the keys instead of ','
+ */
+void format_timing(const TimingConfig* cfg, int levels, char sep, char* buf, size_t size);
+
+/*
+ * timing_create - Time accesses to levels cache levels whose L1 has
+ *     2^b byte blocks. Returns NULL if it cannot be allocated.
+ */
+Timing* timing_create(const TimingConfig* cfg, int levels, int b);
+
+/*
+ * timing_access - Time the next access in program order. level is the
+ *     level that served it (levels for DRAM, or TIMING_AROUND), and
+ *     memory_read and memory_written the bytes it moved to and from DRAM.
+ */
+void timing_access(Timing* t, unsigned long long address, int write, int level,
+                   unsigned long long memory_read, unsigned long long memory_written);
+
+/* timing_stats - Cycles and counts so far */
+void timing_stats(const Timing* t, TimingStats* stats);
+
+/*
+ * timing_clear - Zero the counts and start the cycle count afresh, but
+ *     keep the misses in flight
+ */
+void timing_clear(Timing* t);
+
+/* timing_save - Write the whole timing state to fp. Returns -1 on a write error. */
+int timing_save(const Timing* t, FILE* fp);
+
+/*
+ * timing_load - Read what timing_save wrote into a model of the same
+ *     configuration. Returns -1 if it cannot be read.
+ */
+int timing_load(Timing* t, FILE* fp);
+
+/* timing_free - Release the model */
+void timing_free(Timing* t);
+
+#endif /* CACHELAB_TIMING_H */
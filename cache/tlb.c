@@ -0,0 +1,176 @@
+/*
+ * tlb.c - Translation lookaside buffers beside the cache model
+ *
+ * Every TLB level is a cache of page translations: a Cache whose blocks
+ * are pages, so the set index is taken from the page number. A lookup
+ * goes down the levels until one hits and fills every level above it;
+ * a miss in all of them walks the page table and fills them all. No
+ * level is kept inclusive of another, as in most hardware.
+ *
+ * A walk reads one page table entry per radix level above the page, 9
+ * address bits each out of 48: four for 4K pages, three for 2M and two
+ * for 1G. Page walk caches are not modeled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tlb.h"
+#include "snapshot.h"
+
+#define VA_BITS 48         //translated address bits
+#define PT_LEVEL_BITS 9    //page number bits per page table level
+
+struct tlb {
+    TlbConfig cfg;
+    Cache level[MAX_TLB_LEVELS];
+    Counters counters[MAX_TLB_LEVELS];
+    int walk_levels;       //page table entries read per walk
+    unsigned long long walks;
+};
+
+/*
+ * parse_page - Parse a power of two number of bytes with an optional K,
+ *     M or G suffix. Returns its log2 or -1.
+ */
+static int parse_page(const char* arg) {
+    char* end;
+    unsigned long long bytes = strtoull(arg, &end, 10);
+    if(end == arg)
+        return -1;
+    if(*end == 'K' || *end == 'k')
+        bytes <<= 10, ++end;
+    else if(*end == 'M' || *end == 'm')
+        bytes <<= 20, ++end;
+    else if(*end == 'G' || *end == 'g')
+        bytes <<= 30, ++end;
+    if(*end || bytes == 0 || (bytes & (bytes - 1)))
+        return -1;
+    return __builtin_ctzll(bytes);
+}
+
+int parse_tlb(const char* arg, TlbConfig* cfg) {
+    const char* colon = strchr(arg, ':');
+    char page[32];
+    if(!colon || (size_t)(colon - arg) >= sizeof(page))
+        return -1;
+    memcpy(page, arg, colon - arg);
+    page[colon - arg] = '\0';
+    cfg->page_bits = parse_page(page);
+    if(cfg->page_bits < 10 || cfg->page_bits > 40)
+        return -1;
+    cfg->levels = 0;
+    for(const char* p = colon + 1; ; ++p) {
+        char* end;
+        if(cfg->levels == MAX_TLB_LEVELS)
+            return -1;
+        int entries = strtol(p, &end, 10);
+        if(end == p || *end != ':')
+            return -1;
+        p = end + 1;
+        int ways = strtol(p, &end, 10);
+        if(end == p || (*end && *end != ','))
+            return -1;
+        if(entries <= 0 || ways <= 0 || entries % ways || ((entries / ways) & (entries / ways - 1)))
+            return -1;
+        cfg->entries[cfg->levels] = entries;
+        cfg->ways[cfg->levels++] = ways;
+        if(!*end)
+            return 0;
+        p = end;
+    }
+}
+
+void format_tlb(const TlbConfig* cfg, char sep, char* buf, size_t size) {
+    static const char suffix[] = {'\0', 'K', 'M', 'G'};
+    int unit = cfg->page_bits / 10 < 3 ? cfg->page_bits / 10 : 3;
+    size_t len = snprintf(buf, size, "%llu%.1s", 1ULL << (cfg->page_bits - 10 * unit), &suffix[unit]);
+    for(int i = 0; i < cfg->levels && len < size; ++i)
+        len += snprintf(buf + len, size - len, "%c%d:%d", i ? sep : ':', cfg->entries[i], cfg->ways[i]);
+}
+
+Tlb* tlb_create(const TlbConfig* cfg) {
+    Tlb* t = calloc(1, sizeof(Tlb));
+    if(!t)
+        return NULL;
+    t->cfg = *cfg;
+    for(int i = 0; i < cfg->levels; ++i) {
+        int sets = cfg->entries[i] / cfg->ways[i];
+        if(init_cache(&t->level[i], __builtin_ctz(sets), cfg->ways[i], cfg->page_bits, policies[0], 0) < 0) {
+            while(i--)
+                free_cache(&t->level[i]);
+            free(t);
+            return NULL;
+        }
+    }
+    t->walk_levels = (VA_BITS - cfg->page_bits + PT_LEVEL_BITS - 1) / PT_LEVEL_BITS;
+    if(t->walk_levels < 1)
+        t->walk_levels = 1;
+    return t;
+}
+
+/*
+ * translate - Look one page up, level by level
+ */
+static void translate(Tlb* t, unsigned long long address) {
+    int lv;
+    for(lv = 0; lv < t->cfg.levels; ++lv)
+        if(lookup_cache(&t->level[lv], &t->counters[lv], address))
+            break;
+    if(lv == t->cfg.levels)
+        ++t->walks;
+    while(lv--)
+        fill_cache(&t->level[lv], &t->counters[lv], address, 0, NULL);
+}
+
+void tlb_access(Tlb* t, unsigned long long address, int size) {
+    unsigned long long last = size > 1 ? address + (size - 1) : address;
+    if(last < address) //wrapped past the top of memory
+        last = ~0ULL;
+    for(unsigned long long page = address >> t->cfg.page_bits; ; ++page) {
+        translate(t, page << t->cfg.page_bits);
+        if(page == last >> t->cfg.page_bits)
+            break;
+    }
+}
+
+void tlb_stats(const Tlb* t, TlbStats* stats) {
+    memset(stats, 0, sizeof(TlbStats));
+    stats->levels = t->cfg.levels;
+    for(int i = 0; i < t->cfg.levels; ++i) {
+        stats->counters[i] = t->counters[i];
+        stats->valid[i] = valid_lines(&t->level[i]);
+    }
+    stats->walks = t->walks;
+    stats->walk_references = t->walks * t->walk_levels;
+}
+
+void tlb_clear(Tlb* t) {
+    for(int i = 0; i < t->cfg.levels; ++i) { //the clocks keep running
+        unsigned long long now = t->counters[i].time_counter;
+        memset(&t->counters[i], 0, sizeof(Counters));
+        t->counters[i].time_counter = now;
+    }
+    t->walks = 0;
+}
+
+int tlb_save(const Tlb* t, FILE* fp) {
+    for(int i = 0; i < t->cfg.levels; ++i)
+        if(save_cache(&t->level[i], fp) < 0 || snap_put(fp, &t->counters[i], sizeof(Counters)) < 0)
+            return -1;
+    return snap_put(fp, &t->walks, sizeof(t->walks));
+}
+
+int tlb_load(Tlb* t, FILE* fp) {
+    for(int i = 0; i < t->cfg.levels; ++i)
+        if(load_cache(&t->level[i], fp) < 0 || snap_get(fp, &t->counters[i], sizeof(Counters)) < 0)
+            return -1;
+    return snap_get(fp, &t->walks, sizeof(t->walks));
+}
+
+void tlb_free(Tlb* t) {
+    if(!t)
+        return;
+    for(int i = 0; i < t->cfg.levels; ++i)
+        free_cache(&t->level[i]);
+    free(t);
+}
@@ -0,0 +1,77 @@
+/*
+ * tlb.h - Translation lookaside buffers beside the cache model
+ */
+
+#ifndef CACHELAB_TLB_H
+#define CACHELAB_TLB_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "cache.h"
+
+#define MAX_TLB_LEVELS 3
+
+typedef struct {
+    int page_bits;                   //pages of 2^page_bits bytes
+    int levels;
+    int entries[MAX_TLB_LEVELS];
+    int ways[MAX_TLB_LEVELS];        //entries for a fully associative level
+} TlbConfig;
+
+typedef struct {
+    int levels;
+    Counters counters[MAX_TLB_LEVELS];     //hits and misses per level
+    unsigned long long valid[MAX_TLB_LEVELS]; //entries holding a translation
+    unsigned long long walks;              //misses in every level
+    unsigned long long walk_references;    //page table entries the walks read
+} TlbStats;
+
+typedef struct tlb Tlb;
+
+/*
+ * parse_tlb - Parse "page:entries:ways[,entries:ways]..." with one
+ *     entries:ways pair per level, L1 TLB first. page is a power of two
+ *     number of bytes, optionally with a K, M or G suffix (4K, 2M, 1G).
+ *     entries / ways must be a power of two. Returns -1 if it is
+ *     malformed.
+ */
+int parse_tlb(const char* arg, TlbConfig* cfg);
+
+/*
+ * format_tlb - Write cfg as parse_tlb accepts it, with sep between the
+ *     levels instead of ','
+ */
+void format_tlb(const TlbConfig* cfg, char sep, char* buf, size_t size);
+
+/*
+ * tlb_create - Build LRU TLB levels, each filled on a miss below it, in
+ *     front of a page walk through a four-level radix page table of a
+ *     48-bit address space. Returns NULL if they cannot be allocated.
+ */
+Tlb* tlb_create(const TlbConfig* cfg);
+
+/*
+ * tlb_access - Translate every page an access of size bytes covers
+ *     (size <= 1 translates one)
+ */
+void tlb_access(Tlb* t, unsigned long long address, int size);
+
+/* tlb_stats - Counters accumulated so far; counting valid entries scans them */
+void tlb_stats(const Tlb* t, TlbStats* stats);
+
+/* tlb_clear - Zero the counters but keep the translations */
+void tlb_clear(Tlb* t);
+
+/* tlb_save - Write the translations and counters to fp. Returns -1 on a write error. */
+int tlb_save(const Tlb* t, FILE* fp);
+
+/*
+ * tlb_load - Read what tlb_save wrote into a TLB of the same
+ *     configuration. Returns -1 if it cannot be read.
+ */
+int tlb_load(Tlb* t, FILE* fp);
+
+/* tlb_free - Release the TLB */
+void tlb_free(Tlb* t);
+
+#endif /* CACHELAB_TLB_H */
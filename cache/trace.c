@@ -0,0 +1,676 @@
+/*
+ * trace.c - Readers and writers for memory traces
+ *
+ * Regular files are mapped into memory and scanned in place; pipes and
+ * stdin are read() through a rolling buffer. Either way each record is
+ * parsed by hand from the bytes, which is several times faster than
+ * pushing every line through fscanf. The fscanf reader is still
+ * available as TRACE_STDIO so the two can be timed against each other.
+ *
+ * Binary traces are laid out as follows (all integers little-endian):
+ *
+ *   header   "CSIMTRC1" u32 block_records, u32 reserved
+ *   block    u32 nrecords, u32 nbytes, then nrecords encoded records
+ *   ...      (every block but the last holds exactly block_records)
+ *   end      a block header with nrecords == 0
+ *   index    u64 file offset of every block header
+ *   footer   u64 index offset, u64 nblocks, u64 nrecords, "CSIMIDX1"
+ *
+ * A record is one byte holding the op in bits 0-1 (L=0, S=1, M=2), the
+ * size in bits 2-6 (31 means a varint size follows) and in bit 7 whether
+ * a varint core follows the size, then the zigzag varint of the address
+ * minus the previous address in the same block.
+ * Each block starts again from address 0 so it can be decoded on its own,
+ * which is what lets the index turn a seek into a jump plus a short scan.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+#include "workload.h"
+
+/* Size of the rolling buffer used when the trace cannot be mapped */
+#define TRACE_BUF_SIZE (1 << 20)
+
+/* Refill the buffer once fewer than this many bytes are left */
+#define TRACE_LINE_MAX 256
+
+#define BIN_MAGIC "CSIMTRC1"
+#define BIN_END_MAGIC "CSIMIDX1"
+#define BIN_HEADER_SIZE 16
+#define BIN_BLOCK_HEADER_SIZE 8
+#define BIN_FOOTER_SIZE 32
+#define BIN_SIZE_ESCAPE 31
+#define BIN_CORE_FLAG 0x80
+#define BIN_RECORD_MAX 21 //header byte + 5 byte size + 5 byte core + 10 byte delta
+
+struct trace_reader {
+    TraceMode mode;
+    TraceFormat format;
+    int fd;
+    int own_fd;        //close fd in trace_close
+    FILE* fp;          //TRACE_STDIO, and binary stdin found under it
+    char* map;         //TRACE_MMAP: the mapped file
+    size_t map_len;
+    char* buf;         //TRACE_STREAM: the rolling buffer
+    const char* pos;   //next unparsed byte
+    const char* end;   //one past the last valid byte
+    int eof;           //no bytes will arrive after end
+    unsigned long long record;  //records returned so far
+
+    //Binary traces
+    unsigned int block_records;
+    unsigned int block_left;    //records still to decode in this block
+    unsigned long long prev;    //previous address in this block
+    int done;                   //end block (or damage) reached
+    const char* index;          //block index, mapped traces only
+    unsigned long long nblocks;
+    unsigned long long total;   //records in the whole trace
+
+    Workload* gen;              //"gen:" patterns
+};
+
+struct trace_writer {
+    TraceFormat format;
+    FILE* fp;
+    unsigned int block_records;
+    unsigned char* block;       //encoded records of the open block
+    size_t block_len;
+    unsigned int block_count;   //records in the open block
+    unsigned long long prev;
+    unsigned long long offset;  //bytes written so far
+    unsigned long long* index;  //offsets of finished blocks
+    size_t nblocks, index_cap;
+    unsigned long long records;
+    int error;
+};
+
+/*
+ * hex_value - Value of a hexadecimal digit, or -1 if c is not one
+ */
+static inline int hex_value(unsigned char c) {
+    if((unsigned char)(c - '0') < 10)
+        return c - '0';
+    c |= 0x20; //fold to lower case
+    if((unsigned char)(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+static unsigned long long get_le(const char* p, int bytes) {
+    unsigned long long v = 0;
+    for(int i = bytes - 1; i >= 0; --i)
+        v = (v << 8) | (unsigned char)p[i];
+    return v;
+}
+
+static void put_le(unsigned char* p, unsigned long long v, int bytes) {
+    for(int i = 0; i < bytes; ++i, v >>= 8)
+        p[i] = v & 0xff;
+}
+
+/*
+ * get_varint - Decode a LEB128 varint at *p, stopping at end. Returns 0
+ *     if the varint is truncated or longer than 64 bits.
+ */
+static inline int get_varint(const char** p, const char* end,
+                             unsigned long long* v) {
+    unsigned long long x = 0;
+    for(int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char c = *(*p)++;
+        x |= (unsigned long long)(c & 0x7f) << shift;
+        if(!(c & 0x80)) {
+            *v = x;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline size_t put_varint(unsigned char* p, unsigned long long v) {
+    size_t n = 0;
+    while(v >= 0x80) {
+        p[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+/*
+ * trace_fill - Move the unparsed tail to the front of the buffer and
+ *     read until it holds at least TRACE_LINE_MAX bytes or the input ends
+ */
+static void trace_fill(TraceReader* tr) {
+    size_t left = tr->end - tr->pos;
+    memmove(tr->buf, tr->pos, left);
+    tr->pos = tr->buf;
+    while(!tr->eof && left < TRACE_LINE_MAX) {
+        ssize_t n = tr->fp ? (ssize_t)fread(tr->buf + left, 1, TRACE_BUF_SIZE - left, tr->fp)
+                           : read(tr->fd, tr->buf + left, TRACE_BUF_SIZE - left);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0) {
+            tr->eof = 1;
+            break;
+        }
+        left += n;
+    }
+    tr->end = tr->buf + left;
+}
+
+/*
+ * trace_skip_line - Advance past the newline that ends the current line,
+ *     refilling the buffer if the line runs past it
+ */
+static void trace_skip_line(TraceReader* tr, const char* p) {
+    for(;;) {
+        const char* nl = memchr(p, '\n', tr->end - p);
+        if(nl) {
+            tr->pos = nl + 1;
+            return;
+        }
+        tr->pos = tr->end;
+        if(tr->eof)
+            return;
+        trace_fill(tr);
+        p = tr->pos;
+        if(p == tr->end)
+            return;
+    }
+}
+
+/*
+ * trace_check_binary - If the unread bytes start with a binary header,
+ *     switch the reader to the binary format. For mapped traces also
+ *     locate the block index. Returns -1 if the header or footer is
+ *     damaged.
+ */
+static int trace_check_binary(TraceReader* tr) {
+    if(tr->end - tr->pos < BIN_HEADER_SIZE ||
+        memcmp(tr->pos, BIN_MAGIC, 8) != 0)
+        return 0;
+    tr->format = TRACE_BINARY;
+    tr->block_records = get_le(tr->pos + 8, 4);
+    if(tr->block_records == 0)
+        return -1;
+    tr->pos += BIN_HEADER_SIZE;
+    if(!tr->map)
+        return 0;
+
+    //The whole file is in memory, so the index can be used for seeks
+    if(tr->map_len < BIN_HEADER_SIZE + BIN_BLOCK_HEADER_SIZE + BIN_FOOTER_SIZE)
+        return -1;
+    const char* footer = tr->map + tr->map_len - BIN_FOOTER_SIZE;
+    if(memcmp(footer + 24, BIN_END_MAGIC, 8) != 0)
+        return -1;
+    unsigned long long index_off = get_le(footer, 8);
+    tr->nblocks = get_le(footer + 8, 8);
+    tr->total = get_le(footer + 16, 8);
+    if(index_off > tr->map_len - BIN_FOOTER_SIZE ||
+        tr->nblocks > (tr->map_len - BIN_FOOTER_SIZE - index_off) / 8)
+        return -1;
+    tr->index = tr->map + index_off;
+    return 0;
+}
+
+/*
+ * trace_attach - Map or start streaming tr->fd and check the binary
+ *     header if there is one. Frees tr and returns NULL on failure.
+ */
+static TraceReader* trace_attach(TraceReader* tr, TraceMode mode) {
+    //Map regular files; anything else falls back to streaming
+    struct stat st;
+    if(mode != TRACE_STREAM && fstat(tr->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        tr->mode = TRACE_MMAP;
+        tr->eof = 1;
+        if(st.st_size == 0)
+            return tr;
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, tr->fd, 0);
+        if(map != MAP_FAILED) {
+            posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+            tr->map = map;
+            tr->map_len = st.st_size;
+            tr->pos = tr->map;
+            tr->end = tr->map + tr->map_len;
+            if(trace_check_binary(tr) < 0) {
+                trace_close(tr);
+                return NULL;
+            }
+            return tr;
+        }
+        tr->eof = 0;
+    }
+
+    tr->mode = TRACE_STREAM;
+    tr->buf = malloc(TRACE_BUF_SIZE);
+    if(!tr->buf) {
+        trace_close(tr);
+        return NULL;
+    }
+    tr->pos = tr->end = tr->buf;
+    trace_fill(tr);
+    if(trace_check_binary(tr) < 0) {
+        trace_close(tr);
+        return NULL;
+    }
+    return tr;
+}
+
+/*
+ * trace_peek_stdin - Under TRACE_STDIO, check whether stdin holds a
+ *     binary trace. stdin cannot be rewound, so the magic is matched a
+ *     byte at a time and the first mismatch is pushed back; only a line
+ *     starting like the magic, which is no record, loses those bytes. A
+ *     binary trace is then streamed from stdin through its buffer.
+ *     Frees tr and returns NULL if the binary header is damaged.
+ */
+static TraceReader* trace_peek_stdin(TraceReader* tr) {
+    int n = 0, c;
+    while(n < 8 && (c = getc(tr->fp)) != EOF) {
+        if(c != BIN_MAGIC[n]) {
+            ungetc(c, tr->fp);
+            return tr;
+        }
+        ++n;
+    }
+    if(n < 8)
+        return tr;
+    tr->mode = TRACE_STREAM;
+    tr->buf = malloc(TRACE_BUF_SIZE);
+    if(!tr->buf) {
+        trace_close(tr);
+        return NULL;
+    }
+    memcpy(tr->buf, BIN_MAGIC, 8);
+    tr->pos = tr->buf;
+    tr->end = tr->buf + 8;
+    trace_fill(tr);
+    if(trace_check_binary(tr) < 0) {
+        trace_close(tr);
+        return NULL;
+    }
+    return tr;
+}
+
+TraceReader* trace_open(const char* path, TraceMode mode) {
+    TraceReader* tr = calloc(1, sizeof(TraceReader));
+    if(!tr)
+        return NULL;
+    tr->fd = -1;
+
+    if(strncmp(path, "gen:", 4) == 0) {
+        WorkloadConfig cfg;
+        if(parse_workload(path + 4, &cfg) < 0 || !(tr->gen = workload_create(&cfg))) {
+            free(tr);
+            return NULL;
+        }
+        tr->mode = TRACE_STREAM;
+        tr->format = TRACE_GENERATED;
+        return tr;
+    }
+
+    if(mode == TRACE_STDIO) {
+        tr->mode = TRACE_STDIO;
+        tr->fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+        if(!tr->fp) {
+            free(tr);
+            return NULL;
+        }
+        //fscanf cannot read binary traces; hand those to the fast path
+        char magic[8];
+        if(tr->fp == stdin)
+            return trace_peek_stdin(tr);
+        if(fread(magic, 1, 8, tr->fp) != 8 || memcmp(magic, BIN_MAGIC, 8) != 0) {
+            rewind(tr->fp);
+            return tr;
+        }
+        fclose(tr->fp);
+        tr->fp = NULL;
+        mode = TRACE_AUTO;
+    }
+
+    tr->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if(tr->fd < 0) {
+        free(tr);
+        return NULL;
+    }
+    tr->own_fd = tr->fd != STDIN_FILENO;
+    return trace_attach(tr, mode);
+}
+
+TraceReader* trace_fdopen(int fd, TraceMode mode) {
+    TraceReader* tr = calloc(1, sizeof(TraceReader));
+    if(!tr)
+        return NULL;
+    tr->fd = fd;
+    return trace_attach(tr, mode == TRACE_STDIO ? TRACE_AUTO : mode);
+}
+
+/*
+ * trace_next_binary - Decode the next record of a binary trace
+ */
+static int trace_next_binary(TraceReader* tr, TraceRecord* rec) {
+    static const char ops[] = {'L', 'S', 'M'};
+
+    if(!tr->eof && tr->end - tr->pos < TRACE_LINE_MAX)
+        trace_fill(tr);
+    while(tr->block_left == 0) {
+        if(tr->done)
+            return 0;
+        if(tr->end - tr->pos < BIN_BLOCK_HEADER_SIZE) {
+            tr->done = 1; //truncated trace
+            return 0;
+        }
+        tr->block_left = get_le(tr->pos, 4);
+        tr->pos += BIN_BLOCK_HEADER_SIZE;
+        tr->prev = 0;
+        if(tr->block_left == 0) {
+            tr->done = 1;
+            return 0;
+        }
+        if(!tr->eof && tr->end - tr->pos < TRACE_LINE_MAX)
+            trace_fill(tr);
+    }
+
+    const char* p = tr->pos;
+    unsigned long long size, core = 0, delta;
+    if(p == tr->end)
+        goto damaged;
+    unsigned char h = *p++;
+    if((h & 3) == 3)
+        goto damaged;
+    size = (h >> 2) & 0x1f;
+    if(size == BIN_SIZE_ESCAPE && !get_varint(&p, tr->end, &size))
+        goto damaged;
+    if((h & BIN_CORE_FLAG) && !get_varint(&p, tr->end, &core))
+        goto damaged;
+    if(!get_varint(&p, tr->end, &delta))
+        goto damaged;
+    tr->prev += (delta >> 1) ^ -(delta & 1);
+    tr->pos = p;
+    --tr->block_left;
+    ++tr->record;
+
+    rec->op = ops[h & 3];
+    rec->address = tr->prev;
+    rec->size = size;
+    rec->core = core;
+    return 1;
+
+damaged:
+    tr->block_left = 0;
+    tr->done = 1;
+    return 0;
+}
+
+int trace_next(TraceReader* tr, TraceRecord* rec) {
+    if(tr->gen) {
+        if(!workload_next(tr->gen, rec))
+            return 0;
+        ++tr->record;
+        return 1;
+    }
+    if(tr->format == TRACE_BINARY)
+        return trace_next_binary(tr, rec);
+
+    if(tr->mode == TRACE_STDIO) {
+        char op;
+        unsigned long long address;
+        int size, n;
+        while((n = fscanf(tr->fp, " %c %llx,%d", &op, &address, &size)) != EOF) {
+            if(n == 3 && (op == 'L' || op == 'S' || op == 'M')) {
+                int c = getc(tr->fp);
+                rec->core = 0;
+                if(c == ',' && fscanf(tr->fp, "%d", &rec->core) != 1)
+                    rec->core = 0;
+                else if(c != ',' && c != EOF)
+                    ungetc(c, tr->fp);
+                rec->op = op;
+                rec->address = address;
+                rec->size = size;
+                ++tr->record;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    for(;;) {
+        if(!tr->eof && tr->end - tr->pos < TRACE_LINE_MAX)
+            trace_fill(tr);
+        const char* p = tr->pos;
+        const char* end = tr->end;
+        if(p == end)
+            return 0;
+
+        while(p < end && (*p == ' ' || *p == '\t'))
+            ++p;
+        char op = p < end ? *p++ : 0;
+        if((op != 'L' && op != 'S' && op != 'M') ||
+            p == end || (*p != ' ' && *p != '\t')) { //instruction fetch or noise
+            trace_skip_line(tr, p);
+            continue;
+        }
+        while(p < end && (*p == ' ' || *p == '\t'))
+            ++p;
+
+        unsigned long long address = 0;
+        int digits = 0, d;
+        while(p < end && (d = hex_value(*p)) >= 0) {
+            address = (address << 4) | d;
+            ++digits;
+            ++p;
+        }
+        int size = 0, core = 0;
+        if(p < end && *p == ',') {
+            ++p;
+            while(p < end && (unsigned char)(*p - '0') < 10)
+                size = size * 10 + (*p++ - '0');
+        }
+        if(p < end && *p == ',') { //tagged with the core that made it
+            ++p;
+            while(p < end && (unsigned char)(*p - '0') < 10)
+                core = core * 10 + (*p++ - '0');
+        }
+        trace_skip_line(tr, p);
+        if(!digits)
+            continue;
+
+        rec->op = op;
+        rec->address = address;
+        rec->size = size;
+        rec->core = core;
+        ++tr->record;
+        return 1;
+    }
+}
+
+int trace_seek(TraceReader* tr, unsigned long long pos) {
+    if(tr->index) {
+        if(pos > tr->total)
+            return -1;
+        unsigned long long blk = pos / tr->block_records;
+        tr->block_left = 0;
+        if(blk >= tr->nblocks) { //pos is the end of the trace
+            tr->pos = tr->end;
+            tr->done = 1;
+            tr->record = pos;
+            return 0;
+        }
+        unsigned long long off = get_le(tr->index + 8 * blk, 8);
+        if(off > tr->map_len - BIN_BLOCK_HEADER_SIZE)
+            return -1;
+        tr->pos = tr->map + off;
+        tr->done = 0;
+        tr->record = blk * tr->block_records;
+    }
+    else if(pos < tr->record) {
+        return -1;
+    }
+
+    TraceRecord rec;
+    while(tr->record < pos)
+        if(!trace_next(tr, &rec))
+            return -1;
+    return 0;
+}
+
+unsigned long long trace_tell(const TraceReader* tr) {
+    return tr->record;
+}
+
+TraceMode trace_mode(const TraceReader* tr) {
+    return tr->mode;
+}
+
+TraceFormat trace_format(const TraceReader* tr) {
+    return tr->format;
+}
+
+void trace_close(TraceReader* tr) {
+    if(!tr)
+        return;
+    if(tr->map)
+        munmap(tr->map, tr->map_len);
+    free(tr->buf);
+    if(tr->fp && tr->fp != stdin)
+        fclose(tr->fp);
+    if(tr->own_fd)
+        close(tr->fd);
+    workload_free(tr->gen);
+    free(tr);
+}
+
+static void trace_emit(TraceWriter* tw, const void* data, size_t len) {
+    if(fwrite(data, 1, len, tw->fp) != len)
+        tw->error = 1;
+    tw->offset += len;
+}
+
+/*
+ * trace_flush_block - Write out the open block and record it in the index
+ */
+static void trace_flush_block(TraceWriter* tw) {
+    unsigned char header[BIN_BLOCK_HEADER_SIZE];
+    if(tw->block_count == 0)
+        return;
+    if(tw->nblocks == tw->index_cap) {
+        size_t cap = tw->index_cap ? 2 * tw->index_cap : 256;
+        unsigned long long* index = realloc(tw->index, cap * sizeof(*index));
+        if(!index) {
+            tw->error = 1;
+            return;
+        }
+        tw->index = index;
+        tw->index_cap = cap;
+    }
+    tw->index[tw->nblocks++] = tw->offset;
+    put_le(header, tw->block_count, 4);
+    put_le(header + 4, tw->block_len, 4);
+    trace_emit(tw, header, sizeof(header));
+    trace_emit(tw, tw->block, tw->block_len);
+    tw->block_len = 0;
+    tw->block_count = 0;
+    tw->prev = 0;
+}
+
+TraceWriter* trace_writer_open(const char* path, TraceFormat format,
+                               unsigned int block_records) {
+    TraceWriter* tw = calloc(1, sizeof(TraceWriter));
+    if(!tw)
+        return NULL;
+    tw->format = format;
+    tw->block_records = block_records ? block_records : TRACE_BLOCK_RECORDS;
+    tw->fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if(!tw->fp) {
+        free(tw);
+        return NULL;
+    }
+    if(format == TRACE_BINARY) {
+        unsigned char header[BIN_HEADER_SIZE] = BIN_MAGIC;
+        tw->block = malloc((size_t)tw->block_records * BIN_RECORD_MAX);
+        if(!tw->block) {
+            trace_writer_close(tw);
+            return NULL;
+        }
+        put_le(header + 8, tw->block_records, 4);
+        trace_emit(tw, header, sizeof(header));
+    }
+    return tw;
+}
+
+int trace_write(TraceWriter* tw, const TraceRecord* rec) {
+    if(tw->format == TRACE_TEXT) {
+        int n = rec->core ? fprintf(tw->fp, " %c %08llx,%d,%d\n", rec->op, rec->address, rec->size, rec->core)
+                          : fprintf(tw->fp, " %c %08llx,%d\n", rec->op, rec->address, rec->size);
+        if(n < 0)
+            tw->error = 1;
+        ++tw->records;
+        return tw->error ? -1 : 0;
+    }
+
+    unsigned char* p = tw->block + tw->block_len;
+    unsigned int op;
+    switch (rec->op) {
+        case 'L': op = 0; break;
+        case 'S': op = 1; break;
+        case 'M': op = 2; break;
+        default: return -1;
+    }
+    unsigned int size = rec->size;
+    if(rec->core)
+        op |= BIN_CORE_FLAG;
+    if(size < BIN_SIZE_ESCAPE) {
+        *p++ = op | size << 2;
+    }
+    else {
+        *p++ = op | BIN_SIZE_ESCAPE << 2;
+        p += put_varint(p, size);
+    }
+    if(rec->core)
+        p += put_varint(p, rec->core);
+    long long delta = (long long)(rec->address - tw->prev);
+    p += put_varint(p, ((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63));
+    tw->prev = rec->address;
+    tw->block_len = p - tw->block;
+    ++tw->records;
+    if(++tw->block_count == tw->block_records)
+        trace_flush_block(tw);
+    return tw->error ? -1 : 0;
+}
+
+int trace_writer_close(TraceWriter* tw) {
+    int error;
+    if(tw->format == TRACE_BINARY && tw->block) {
+        unsigned char buf[BIN_FOOTER_SIZE];
+        trace_flush_block(tw);
+        memset(buf, 0, BIN_BLOCK_HEADER_SIZE);
+        trace_emit(tw, buf, BIN_BLOCK_HEADER_SIZE); //end block
+        unsigned long long index_off = tw->offset;
+        for(size_t i = 0; i < tw->nblocks; ++i) {
+            put_le(buf, tw->index[i], 8);
+            trace_emit(tw, buf, 8);
+        }
+        put_le(buf, index_off, 8);
+        put_le(buf + 8, tw->nblocks, 8);
+        put_le(buf + 16, tw->records, 8);
+        memcpy(buf + 24, BIN_END_MAGIC, 8);
+        trace_emit(tw, buf, BIN_FOOTER_SIZE);
+    }
+    if(fflush(tw->fp) != 0)
+        tw->error = 1;
+    if(tw->fp != stdout && fclose(tw->fp) != 0)
+        tw->error = 1;
+    error = tw->error;
+    free(tw->block);
+    free(tw->index);
+    free(tw);
+    return error ? -1 : 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * trace.h - Readers and writers for memory traces
+ *
+ * Two on-disk formats are understood:
+ *   - text: valgrind lackey output (" L 0421c7f0,4"), one access per line,
+ *     optionally tagged with the core that made it (" L 0421c7f0,4,2")
+ *   - binary: the compact format described in trace.c, with each address
+ *     stored as a varint delta from the previous one and an index of
+ *     fixed-size blocks so a reader can seek to any record
+ * Readers detect the format from the first bytes of the file. A path of
+ * "gen:" followed by a workload.h pattern reads accesses from a synthetic
+ * generator instead of a file.
+ */
+
+#ifndef CACHELAB_TRACE_H
+#define CACHELAB_TRACE_H
+
+/* How the trace is brought into memory */
+typedef enum {
+    TRACE_AUTO = 0, //mmap regular files, stream everything else
+    TRACE_MMAP,     //map the whole file and scan it in place
+    TRACE_STREAM,   //read() into a rolling buffer (pipes, stdin)
+    TRACE_STDIO     //legacy fscanf path for text, kept for comparison
+} TraceMode;
+
+/* On-disk encoding of a trace */
+typedef enum {
+    TRACE_TEXT = 0,
+    TRACE_BINARY,
+    TRACE_GENERATED //no file: "gen:" patterns
+} TraceFormat;
+
+/* Records per block in binary traces written with block_records == 0 */
+#define TRACE_BLOCK_RECORDS 4096
+
+/* One data access from the trace ("I" records are never returned) */
+typedef struct {
+    char op;                    //'L', 'S' or 'M'
+    unsigned long long address; //64-bit hexadecimal address
+    int size;                   //number of bytes accessed
+    int core;                   //core that made it (",core" tag), 0 if untagged
+} TraceRecord;
+
+typedef struct trace_reader TraceReader;
+typedef struct trace_writer TraceWriter;
+
+/*
+ * trace_open - Open a trace file for reading. A path of "-" reads
+ *     from standard input and "gen:<pattern>" from a generator. Returns
+ *     NULL if the file cannot be opened, is a damaged binary trace or
+ *     the pattern is malformed.
+ */
+TraceReader* trace_open(const char* path, TraceMode mode);
+
+/*
+ * trace_fdopen - Read a trace from an open descriptor, such as the read
+ *     end of a pipe. TRACE_STDIO is treated as TRACE_AUTO. trace_close
+ *     leaves fd open. Returns NULL as trace_open does.
+ */
+TraceReader* trace_fdopen(int fd, TraceMode mode);
+
+/*
+ * trace_next - Fetch the next data access. Returns 1 when rec was
+ *     filled in and 0 at the end of the trace.
+ */
+int trace_next(TraceReader* tr, TraceRecord* rec);
+
+/*
+ * trace_seek - Position the reader so the next record returned is
+ *     record number pos (counting from 0). Indexed binary traces jump
+ *     straight to the right block; other traces can only skip forward.
+ *     Returns 0 on success and -1 if pos cannot be reached.
+ */
+int trace_seek(TraceReader* tr, unsigned long long pos);
+
+/* trace_tell - Number of records returned (or skipped) so far */
+unsigned long long trace_tell(const TraceReader* tr);
+
+/* trace_mode - The mode actually chosen for an open trace */
+TraceMode trace_mode(const TraceReader* tr);
+
+/* trace_format - The format detected for an open trace */
+TraceFormat trace_format(const TraceReader* tr);
+
+/* trace_close - Release the reader and everything it holds */
+void trace_close(TraceReader* tr);
+
+/*
+ * trace_writer_open - Create a trace file in the given format. A path
+ *     of "-" writes to standard output. block_records sets the binary
+ *     block size (0 picks TRACE_BLOCK_RECORDS). Returns NULL on failure.
+ */
+TraceWriter* trace_writer_open(const char* path, TraceFormat format,
+                               unsigned int block_records);
+
+/* trace_write - Append one record. Returns 0 on success, -1 on error */
+int trace_write(TraceWriter* tw, const TraceRecord* rec);
+
+/*
+ * trace_writer_close - Flush buffered records, write the block index
+ *     and close the file. Returns 0 on success, -1 on error.
+ */
+int trace_writer_close(TraceWriter* tw);
+
+#endif /* CACHELAB_TRACE_H */
@@ -0,0 +1,95 @@
+/*
+ * traceconv.c - Convert memory traces between the valgrind lackey text
+ *     format and the compact binary format read by csim and test-trans.
+ *
+ * The input format is detected automatically, so the same tool turns a
+ * text trace into a binary one and a binary trace back into text.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "trace.h"
+
+/*
+ * usage - Print usage info
+ */
+void usage(char* argv[]) {
+    printf("Usage: %s [-h] [-f <format>] [-B <records>] -i <in> -o <out>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h            Print this help message.\n");
+    printf("  -f <format>   Output format, \"binary\" (default) or \"text\".\n");
+    printf("  -B <records>  Records per binary block (default %d).\n", TRACE_BLOCK_RECORDS);
+    printf("  -i <in>       Input trace, either format (\"-\" reads stdin).\n");
+    printf("  -o <out>      Output trace (\"-\" writes stdout).\n");
+    printf("Example: %s -i traces/long.trace -o long.bin\n", argv[0]);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    char* in = NULL;
+    char* out = NULL;
+    TraceFormat format = TRACE_BINARY;
+    unsigned int block_records = 0;
+
+    while((opt = getopt(argc, argv, "f:B:i:o:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                if(strcmp(optarg, "binary") == 0)
+                    format = TRACE_BINARY;
+                else if(strcmp(optarg, "text") == 0)
+                    format = TRACE_TEXT;
+                else {
+                    usage(argv);
+                    exit(1);
+                }
+                break;
+            case 'B':
+                block_records = atoi(optarg);
+                break;
+            case 'i':
+                in = optarg;
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 'h':
+                usage(argv);
+                exit(0);
+            default:
+                usage(argv);
+                exit(1);
+        }
+    }
+
+    if(!in || !out) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    TraceReader* tr = trace_open(in, TRACE_AUTO);
+    if(!tr) {
+        fprintf(stderr, "Error: Unable to read trace %s\n", in);
+        exit(1);
+    }
+    TraceWriter* tw = trace_writer_open(out, format, block_records);
+    if(!tw) {
+        fprintf(stderr, "Error: Unable to create %s\n", out);
+        exit(1);
+    }
+
+    TraceRecord rec;
+    while(trace_next(tr, &rec)) {
+        if(trace_write(tw, &rec) < 0)
+            break;
+    }
+    unsigned long long records = trace_tell(tr);
+    trace_close(tr);
+    if(trace_writer_close(tw) < 0) {
+        fprintf(stderr, "Error: Failed writing %s\n", out);
+        exit(1);
+    }
+    fprintf(stderr, "%llu records\n", records);
+    return 0;
+}
@@ -4,7 +4,12 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file (.marker, or the file given with -m)
+ * for later use.
+ *
+ * With -t, tracegen captures the accesses to A and B itself (see
+ * capture.c) and writes them, between the two marker stores, to a trace
+ * file, so no valgrind run is needed.
  */
 
 #include <stdlib.h>
@@ -13,6 +18,8 @@
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "capture.h"
+#include "trace.h"
 #include <string.h>
 
 /* External variables declared in cachelab.c */
@@ -25,8 +32,9 @@ extern void registerFunctions();
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
-static int A[256][256];
-static int B[256][256];
+/* Page aligned so capture.c can protect exactly the two matrices */
+static int A[256][256] __attribute__((aligned(4096)));
+static int B[256][256] __attribute__((aligned(4096)));
 static int M;
 static int N;
 
@@ -46,12 +54,54 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * run_captured - Run one transpose function with its accesses to A and
+ *     B captured, and append them to tw between the marker stores.
+ *     Returns -1 if they cannot be captured or written.
+ */
+static int run_captured(int fn, TraceWriter* tw) {
+    static TraceRecord* buf;
+    size_t cap = 16 * sizeof(A) / sizeof(A[0][0]); /* far more than any transpose makes */
+    void* const regions[] = {A, B};
+    const size_t sizes[] = {sizeof(A), sizeof(B)};
+    TraceRecord marker = {'S', (unsigned long long)&MARKER_START, 1, 0};
+
+    if(!buf && !(buf = malloc(cap * sizeof(TraceRecord))))
+        return -1;
+    MARKER_START = 33;
+    if(capture_start(regions, sizes, 2, buf, cap) < 0) {
+        fprintf(stderr, "Error: Accesses cannot be captured natively here\n");
+        return -1;
+    }
+    (*func_list[fn].func_ptr)(M, N, A, B);
+    long n = capture_stop();
+    MARKER_END = 34;
+    if(n == -2) {
+        fprintf(stderr, "Error: Function %d touched too many pages in one instruction\n", fn);
+        return -1;
+    }
+    if(n < 0) {
+        fprintf(stderr, "Error: Function %d made more than %zu accesses\n", fn, cap);
+        return -1;
+    }
+
+    int error = trace_write(tw, &marker);
+    for(long k = 0; k < n; k++)
+        error |= trace_write(tw, &buf[k]);
+    marker.address = (unsigned long long)&MARKER_END;
+    error |= trace_write(tw, &marker);
+    return error;
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    char* trace_file = NULL;
+    char* marker_file = ".marker";
+    TraceWriter* tw = NULL;
+    while( (c=getopt(argc,argv,"M:N:F:t:m:")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +112,12 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 't':
+            trace_file = optarg;
+            break;
+        case 'm':
+            marker_file = optarg;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -77,30 +133,50 @@ int main(int argc, char* argv[]){
     initMatrix(M,N, A, B); 
 
     /* Record marker addresses */
-    FILE* marker_fp = fopen(".marker","w");
+    FILE* marker_fp = fopen(marker_file,"w");
     assert(marker_fp);
     fprintf(marker_fp, "%llx %llx", 
             (unsigned long long int) &MARKER_START,
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
+    /* Capture natively instead of under valgrind */
+    if (trace_file && !(tw = trace_writer_open(trace_file, TRACE_BINARY, 0))) {
+        fprintf(stderr, "Error: Unable to create %s\n", trace_file);
+        exit(1);
+    }
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
+            if (tw) {
+                if (run_captured(i, tw) < 0)
+                    exit(1);
+            } else {
+                MARKER_START = 33;
+                (*func_list[i].func_ptr)(M, N, A, B);
+                MARKER_END = 34;
+            }
             if (!validate(i,M,N,A,B))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
+        if (tw) {
+            if (run_captured(selectedFunc, tw) < 0)
+                exit(1);
+        } else {
+            MARKER_START = 33;
+            (*func_list[selectedFunc].func_ptr)(M, N, A, B);
+            MARKER_END = 34;
+        }
         if (!validate(selectedFunc,M,N,A,B))
             return selectedFunc+1;
 
     }
+    if (tw && trace_writer_close(tw) < 0) {
+        fprintf(stderr, "Error: Failed writing %s\n", trace_file);
+        exit(1);
+    }
     return 0;
 }
 
@@ -0,0 +1,140 @@
+/*
+ * victim.c - Victim cache and miss cache models for the cache model
+ *
+ * Both are small fully associative LRU buffers between a cache and the
+ * next level (Jouppi, 1990), probed on every miss of the cache:
+ *
+ *   victim  holds the lines the cache evicts, dirty ones included. A
+ *           miss that finds its block there swaps it with the line the
+ *           cache evicts for it, so a block lives in one or the other.
+ *   miss    holds a clean copy of the block of every miss. A miss that
+ *           finds its block there fills the cache from it and the copy
+ *           stays; the cache writes its own dirty lines back as usual.
+ *
+ * A miss the buffer serves is still a miss of the cache, but it reads
+ * nothing from the next level, so the buffer's hits are exactly the
+ * misses it would save. Stores that miss a no-write-allocate cache go
+ * around both, except that a write-back victim cache holding the block
+ * takes the store.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "victim.h"
+#include "snapshot.h"
+
+#define DEFAULT_ENTRIES 4
+#define MAX_ENTRIES 4096
+
+struct victim {
+    VictimConfig cfg;
+    Cache* c;
+    Cache buffer;             //one set of cfg.entries ways
+    Counters clock;           //the buffer's time; its hits count in the cache's counters
+};
+
+static const char* const kind_names[] = {"victim", "miss"};
+
+const char* victim_name(VictimKind kind) {
+    return kind_names[kind];
+}
+
+int parse_victim(const char* arg, VictimConfig* cfg) {
+    const char* colon = strchr(arg, ':');
+    size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+    int i;
+    for(i = 0; i < 2 && (strlen(kind_names[i]) != len || strncmp(arg, kind_names[i], len) != 0); ++i)
+        ;
+    if(i == 2)
+        return -1;
+    cfg->kind = i;
+    cfg->entries = DEFAULT_ENTRIES;
+    if(colon) {
+        char* end;
+        cfg->entries = strtol(colon + 1, &end, 10);
+        if(end == colon + 1 || *end)
+            return -1;
+    }
+    if(cfg->entries < 1 || cfg->entries > MAX_ENTRIES)
+        return -1;
+    return 0;
+}
+
+Victim* victim_create(const VictimConfig* cfg, Cache* c) {
+    Victim* v = calloc(1, sizeof(Victim));
+    if(!v)
+        return NULL;
+    v->cfg = *cfg;
+    v->c = c;
+    if(init_cache(&v->buffer, 0, cfg->entries, c->b, policies[0], 0) < 0) {
+        free(v);
+        return NULL;
+    }
+    return v;
+}
+
+int victim_access(Victim* v, Counters* cnt, unsigned long long address, int write, int size) {
+    Cache* c = v->c;
+    unsigned long long evicted_block;
+
+    if(lookup_cache(c, cnt, address)) {
+        if(write && c->write_back)
+            write_cache(c, address);
+        else if(write)
+            cnt->bytes_written += size;
+        return ACCESS_HIT;
+    }
+
+    if(write && !c->write_allocate) { //straight to the next level
+        if(v->cfg.kind == VB_VICTIM && c->write_back && lookup_cache(&v->buffer, &v->clock, address)) {
+            write_cache(&v->buffer, address);
+            ++cnt->victim_hit;
+            return ACCESS_MISS;
+        }
+        ++cnt->victim_miss;
+        cnt->bytes_written += size;
+        return ACCESS_MISS;
+    }
+
+    int dirty = write && c->write_back;
+    if(lookup_cache(&v->buffer, &v->clock, address)) {
+        ++cnt->victim_hit;
+        if(v->cfg.kind == VB_VICTIM && invalidate_cache(&v->buffer, address) == LINE_DIRTY)
+            dirty = 1;
+    }
+    else {
+        ++cnt->victim_miss;
+        cnt->bytes_read += 1ULL << c->b;
+        if(v->cfg.kind == VB_MISS)
+            fill_cache(&v->buffer, &v->clock, address, 0, NULL);
+    }
+    int evicted = fill_cache(c, cnt, address, dirty, &evicted_block);
+    if(evicted != LINE_NONE && v->cfg.kind == VB_VICTIM) { //the buffer's own victim leaves instead
+        if(fill_cache(&v->buffer, &v->clock, evicted_block, evicted == LINE_DIRTY, NULL) == LINE_DIRTY)
+            cnt->bytes_written += 1ULL << c->b;
+    }
+    else if(evicted == LINE_DIRTY) {
+        cnt->bytes_written += 1ULL << c->b;
+    }
+    if(write && !c->write_back)
+        cnt->bytes_written += size;
+    return evicted ? ACCESS_EVICT : ACCESS_MISS;
+}
+
+int victim_save(const Victim* v, FILE* fp) {
+    if(save_cache(&v->buffer, fp) < 0)
+        return -1;
+    return snap_put(fp, &v->clock, sizeof(Counters));
+}
+
+int victim_load(Victim* v, FILE* fp) {
+    if(load_cache(&v->buffer, fp) < 0)
+        return -1;
+    return snap_get(fp, &v->clock, sizeof(Counters));
+}
+
+void victim_free(Victim* v) {
+    if(!v)
+        return;
+    free_cache(&v->buffer);
+    free(v);
+}
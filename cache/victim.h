@@ -0,0 +1,58 @@
+/*
+ * victim.h - Victim cache and miss cache models for the cache model
+ */
+
+#ifndef CACHELAB_VICTIM_H
+#define CACHELAB_VICTIM_H
+
+#include <stdio.h>
+#include "cache.h"
+
+typedef enum {
+    VB_VICTIM = 0, //holds the lines the cache evicts; a hit swaps the line back
+    VB_MISS        //holds a copy of every line the cache missed on
+} VictimKind;
+
+typedef struct {
+    VictimKind kind;
+    int entries; //fully associative LRU lines
+} VictimConfig;
+
+typedef struct victim Victim;
+
+/*
+ * parse_victim - Parse "kind[:entries]" where kind is victim or miss.
+ *     Returns -1 if it is malformed.
+ */
+int parse_victim(const char* arg, VictimConfig* cfg);
+
+/* victim_name - Name of a buffer kind as parse_victim accepts it */
+const char* victim_name(VictimKind kind);
+
+/*
+ * victim_create - Put a buffer behind a cache, with the cache's block
+ *     size. Returns NULL if it cannot be allocated.
+ */
+Victim* victim_create(const VictimConfig* cfg, Cache* c);
+
+/*
+ * victim_access - access_cache with the buffer behind the cache. A miss
+ *     the buffer serves still counts as a cache miss, and in victim_hit,
+ *     but reads nothing from the next level. Returns the ACCESS_* outcome
+ *     in the cache.
+ */
+int victim_access(Victim* v, Counters* cnt, unsigned long long address, int write, int size);
+
+/* victim_save - Write the buffer's lines to fp. Returns -1 on a write error. */
+int victim_save(const Victim* v, FILE* fp);
+
+/*
+ * victim_load - Read what victim_save wrote into a buffer of the same
+ *     configuration. Returns -1 if it cannot be read.
+ */
+int victim_load(Victim* v, FILE* fp);
+
+/* victim_free - Release a buffer */
+void victim_free(Victim* v);
+
+#endif /* CACHELAB_VICTIM_H */
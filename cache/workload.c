@@ -0,0 +1,325 @@
+/*
+ * workload.c - Synthetic memory access patterns for the cache model
+ *
+ * Each generator is a small state machine that produces one access per
+ * call, so a pattern of any length costs the same memory as a short one
+ * and can be fed straight into the simulator instead of through a file.
+ * Everything random comes from a splitmix64 stream seeded by cfg.seed,
+ * so a configuration always produces the same accesses.
+ *
+ * Zipf ranks are drawn by rejection-inversion (Hormann and Derflinger,
+ * 1996), O(1) per draw with no table, and then scattered over the
+ * footprint by a fixed permutation so the hot elements do not share a
+ * few neighbouring blocks. The pointer chase follows one cycle through
+ * every node, built with Sattolo's algorithm, so nothing but the node
+ * count bounds its reuse distance.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "workload.h"
+
+#define DEFAULT_BASE 0x10000000ULL
+
+struct workload {
+    WorkloadConfig cfg;
+    unsigned long long state;     //splitmix64
+    unsigned long long produced;
+    unsigned long long pos;       //seq and stride: accesses into the pass
+    unsigned long long elements;  //footprint / size
+
+    //zipf
+    double h_x1, h_n, sc;
+    unsigned long long scatter;   //odd multiplier coprime with elements
+
+    //chase
+    unsigned int* next;
+    unsigned long long cur;
+
+    //matrix
+    unsigned long long ii, jj, i, j;
+    int store;                    //the store half of an element is next
+};
+
+static const char* const kind_names[] = {"seq", "stride", "uniform", "zipf", "chase", "matrix"};
+
+const char* workload_name(WorkloadKind kind) {
+    return kind_names[kind];
+}
+
+/*
+ * parse_count - Parse a decimal or 0x number with an optional K, M or G
+ *     suffix. Returns -1 if it is malformed.
+ */
+static int parse_count(const char* s, const char* end, unsigned long long* v) {
+    char* p;
+    *v = strtoull(s, &p, 0);
+    if(p == s)
+        return -1;
+    if(p < end && (*p == 'K' || *p == 'M' || *p == 'G')) {
+        *v <<= *p == 'K' ? 10 : *p == 'M' ? 20 : 30;
+        ++p;
+    }
+    return p == end ? 0 : -1;
+}
+
+int parse_workload(const char* arg, WorkloadConfig* cfg) {
+    const char* colon = strchr(arg, ':');
+    size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+    int kind;
+    for(kind = 0; kind < WL_KINDS && (strlen(kind_names[kind]) != len || strncmp(arg, kind_names[kind], len) != 0); ++kind)
+        ;
+    if(kind == WL_KINDS)
+        return -1;
+    memset(cfg, 0, sizeof(WorkloadConfig));
+    cfg->kind = kind;
+    cfg->n = 1 << 20;
+    cfg->base = DEFAULT_BASE;
+    cfg->footprint = 1 << 20;
+    cfg->stride = 64;
+    cfg->node = 64;
+    cfg->size = 8;
+    cfg->alpha = 0.99;
+    cfg->dim = 256;
+    cfg->tile = 8;
+    cfg->seed = 1;
+
+    for(const char* p = colon; p && *p; ) {
+        const char* key = p + 1;
+        const char* eq = strchr(key, '=');
+        const char* end = strchr(key, ',');
+        if(!end)
+            end = key + strlen(key);
+        if(!eq || eq > end)
+            return -1;
+        size_t klen = eq - key;
+        const char* val = eq + 1;
+        unsigned long long v = 0;
+        char* dend;
+        if(klen == 5 && strncmp(key, "alpha", 5) == 0) {
+            cfg->alpha = strtod(val, &dend);
+            if(dend != end || !(cfg->alpha >= 0))
+                return -1;
+        }
+        else if(klen == 5 && strncmp(key, "write", 5) == 0) {
+            cfg->write = strtod(val, &dend);
+            if(dend != end || !(cfg->write >= 0 && cfg->write <= 1))
+                return -1;
+        }
+        else if(parse_count(val, end, &v) < 0) {
+            return -1;
+        }
+        else if(klen == 1 && key[0] == 'n')
+            cfg->n = v;
+        else if(klen == 4 && strncmp(key, "base", 4) == 0)
+            cfg->base = v;
+        else if(klen == 9 && strncmp(key, "footprint", 9) == 0)
+            cfg->footprint = v;
+        else if(klen == 6 && strncmp(key, "stride", 6) == 0)
+            cfg->stride = v;
+        else if(klen == 4 && strncmp(key, "node", 4) == 0)
+            cfg->node = v;
+        else if(klen == 4 && strncmp(key, "size", 4) == 0)
+            cfg->size = v > 0 && v <= 4096 ? (int)v : 0;
+        else if(klen == 3 && strncmp(key, "dim", 3) == 0)
+            cfg->dim = v;
+        else if(klen == 4 && strncmp(key, "tile", 4) == 0)
+            cfg->tile = v;
+        else if(klen == 4 && strncmp(key, "seed", 4) == 0)
+            cfg->seed = v;
+        else
+            return -1;
+        p = end;
+    }
+
+    if(cfg->size < 1 || cfg->footprint < (unsigned long long)cfg->size ||
+        cfg->stride < 1 || cfg->dim < 1 || cfg->tile < 1)
+        return -1;
+    if(cfg->kind == WL_CHASE && (cfg->node < 1 || cfg->footprint / cfg->node < 1 ||
+                                  cfg->footprint / cfg->node > 0xffffffffULL))
+        return -1;
+    return 0;
+}
+
+static inline unsigned long long next_random(Workload* w) {
+    unsigned long long z = (w->state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* next_unit - Uniform in [0, 1) */
+static inline double next_unit(Workload* w) {
+    return (next_random(w) >> 11) * (1.0 / (1ULL << 53));
+}
+
+/* zipf_helper1 - log1p(x) / x, accurate near 0 */
+static double zipf_helper1(double x) {
+    return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+/* zipf_helper2 - expm1(x) / x, accurate near 0 */
+static double zipf_helper2(double x) {
+    return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+}
+
+/* zipf_h - The unnormalized density x^-alpha */
+static double zipf_h(const Workload* w, double x) {
+    return exp(-w->cfg.alpha * log(x));
+}
+
+/* zipf_hint - An antiderivative of zipf_h */
+static double zipf_hint(const Workload* w, double x) {
+    double lx = log(x);
+    return zipf_helper2((1 - w->cfg.alpha) * lx) * lx;
+}
+
+static double zipf_hint_inverse(const Workload* w, double x) {
+    double t = x * (1 - w->cfg.alpha);
+    if(t < -1) //only rounding gets it there
+        t = -1;
+    return exp(zipf_helper1(t) * x);
+}
+
+/* zipf_rank - A rank in 1..elements, rank k drawn with weight k^-alpha */
+static unsigned long long zipf_rank(Workload* w) {
+    for(;;) {
+        double u = w->h_n + next_unit(w) * (w->h_x1 - w->h_n);
+        double x = zipf_hint_inverse(w, u);
+        double k = floor(x + 0.5);
+        if(k < 1)
+            k = 1;
+        else if(k > w->elements)
+            k = w->elements;
+        if(k - x <= w->sc || u >= zipf_hint(w, k + 0.5) - zipf_h(w, k))
+            return (unsigned long long)k;
+    }
+}
+
+static unsigned long long gcd(unsigned long long a, unsigned long long b) {
+    while(b) {
+        unsigned long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+Workload* workload_create(const WorkloadConfig* cfg) {
+    Workload* w = calloc(1, sizeof(Workload));
+    if(!w)
+        return NULL;
+    w->cfg = *cfg;
+    w->state = cfg->seed;
+    w->elements = cfg->footprint / cfg->size;
+
+    if(cfg->kind == WL_ZIPF) {
+        w->h_x1 = zipf_hint(w, 1.5) - 1;
+        w->h_n = zipf_hint(w, w->elements + 0.5);
+        w->sc = 2 - zipf_hint_inverse(w, zipf_hint(w, 2.5) - zipf_h(w, 2));
+        w->scatter = 0x9e3779b97f4a7c15ULL % w->elements | 1;
+        while(gcd(w->scatter, w->elements) != 1)
+            w->scatter += 2;
+    }
+    else if(cfg->kind == WL_CHASE) {
+        unsigned long long nodes = cfg->footprint / cfg->node;
+        unsigned int* perm = malloc(nodes * sizeof(unsigned int));
+        w->next = malloc(nodes * sizeof(unsigned int));
+        if(!perm || !w->next) {
+            free(perm);
+            workload_free(w);
+            return NULL;
+        }
+        for(unsigned long long k = 0; k < nodes; ++k)
+            perm[k] = k;
+        for(unsigned long long k = nodes - 1; k > 0; --k) { //Sattolo: one cycle
+            unsigned long long r = next_random(w) % k;
+            unsigned int t = perm[k];
+            perm[k] = perm[r];
+            perm[r] = t;
+        }
+        for(unsigned long long k = 0; k < nodes; ++k)
+            w->next[perm[k]] = perm[(k + 1) % nodes];
+        free(perm);
+    }
+    return w;
+}
+
+/*
+ * matrix_next - The next access of a tiled B = transpose(A) with A at
+ *     base and B right after it, both row-major, loading each element of
+ *     A and then storing it into B
+ */
+static void matrix_next(Workload* w, TraceRecord* rec) {
+    unsigned long long dim = w->cfg.dim, tile = w->cfg.tile, size = w->cfg.size;
+    unsigned long long ilast = w->ii + tile < dim ? w->ii + tile : dim;
+    unsigned long long jlast = w->jj + tile < dim ? w->jj + tile : dim;
+
+    if(!w->store) {
+        rec->op = 'L';
+        rec->address = w->cfg.base + (w->i * dim + w->j) * size;
+        w->store = 1;
+        return;
+    }
+    rec->op = 'S';
+    rec->address = w->cfg.base + (dim * dim + w->j * dim + w->i) * size;
+    w->store = 0;
+    if(++w->j < jlast)
+        return;
+    w->j = w->jj;
+    if(++w->i < ilast)
+        return;
+    if((w->jj += tile) >= dim) {
+        w->jj = 0;
+        if((w->ii += tile) >= dim)
+            w->ii = 0;
+    }
+    w->i = w->ii;
+    w->j = w->jj;
+}
+
+int workload_next(Workload* w, TraceRecord* rec) {
+    const WorkloadConfig* cfg = &w->cfg;
+    if(w->produced == cfg->n)
+        return 0;
+    ++w->produced;
+    rec->size = cfg->size;
+    rec->core = 0;
+    rec->op = 'L';
+
+    switch (cfg->kind) {
+        case WL_SEQ:
+            rec->address = cfg->base + w->pos * cfg->size;
+            if(++w->pos == w->elements)
+                w->pos = 0;
+            break;
+        case WL_STRIDE:
+            rec->address = cfg->base + w->pos;
+            if((w->pos += cfg->stride) > cfg->footprint - cfg->size)
+                w->pos = 0;
+            break;
+        case WL_UNIFORM:
+            rec->address = cfg->base + next_random(w) % w->elements * cfg->size;
+            break;
+        case WL_ZIPF:
+            rec->address = cfg->base + (unsigned long long)((unsigned __int128)(zipf_rank(w) - 1) * w->scatter % w->elements) * cfg->size;
+            break;
+        case WL_CHASE:
+            rec->address = cfg->base + w->cur * cfg->node;
+            w->cur = w->next[w->cur];
+            break;
+        default:
+            matrix_next(w, rec);
+            return 1;
+    }
+    if(cfg->write > 0 && next_unit(w) < cfg->write)
+        rec->op = 'S';
+    return 1;
+}
+
+void workload_free(Workload* w) {
+    if(!w)
+        return;
+    free(w->next);
+    free(w);
+}
@@ -0,0 +1,63 @@
+/*
+ * workload.h - Synthetic memory access patterns for the cache model
+ */
+
+#ifndef CACHELAB_WORKLOAD_H
+#define CACHELAB_WORKLOAD_H
+
+#include "trace.h"
+
+typedef enum {
+    WL_SEQ = 0, //one element after another
+    WL_STRIDE,  //every stride bytes
+    WL_UNIFORM, //uniformly random elements
+    WL_ZIPF,    //elements drawn with Zipf(alpha) popularity
+    WL_CHASE,   //a pointer chase around one random cycle of nodes
+    WL_MATRIX,  //a blocked transpose of a dim x dim matrix
+    WL_KINDS
+} WorkloadKind;
+
+typedef struct {
+    WorkloadKind kind;
+    unsigned long long n;         //accesses to generate
+    unsigned long long base;      //lowest address touched
+    unsigned long long footprint; //bytes the pattern wraps around in
+    unsigned long long stride;    //stride: bytes between accesses
+    unsigned long long node;      //chase: bytes per node
+    int size;                     //bytes per access
+    double alpha;                 //zipf: skew, 0 is uniform
+    double write;                 //fraction of accesses that are stores
+    unsigned long long dim, tile; //matrix: elements per side, per tile side
+    unsigned long long seed;
+} WorkloadConfig;
+
+typedef struct workload Workload;
+
+/*
+ * parse_workload - Parse "kind[:key=value[,key=value]...]" where kind is
+ *     seq, stride, uniform, zipf, chase or matrix and the keys are n,
+ *     base, footprint, stride, node, size, alpha, write, dim, tile and
+ *     seed. Sizes and counts take a K, M or G suffix (powers of 1024).
+ *     Unset keys keep their defaults. Returns -1 if it is malformed.
+ */
+int parse_workload(const char* arg, WorkloadConfig* cfg);
+
+/* workload_name - Name of a pattern as parse_workload accepts it */
+const char* workload_name(WorkloadKind kind);
+
+/*
+ * workload_create - Start generating cfg from its seed. Returns NULL if
+ *     it cannot be allocated.
+ */
+Workload* workload_create(const WorkloadConfig* cfg);
+
+/*
+ * workload_next - Produce the next access. Returns 1 when rec was filled
+ *     in and 0 once cfg.n accesses have been produced.
+ */
+int workload_next(Workload* w, TraceRecord* rec);
+
+/* workload_free - Release the generator */
+void workload_free(Workload* w);
+
+#endif /* CACHELAB_WORKLOAD_H */